@@ -0,0 +1,157 @@
+#include "allocations.hpp"
+
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+using namespace BallSimulator;
+
+namespace {
+    std::atomic<std::uint64_t> Allocations{ 0 }, Frees{ 0 }, Bytes{ 0 };
+    std::atomic<std::size_t> Live{ 0 }, Peak{ 0 };
+
+    // every block starts with a header holding its size, so delete knows how much stops being
+    // live. the header is as wide as the block's alignment to keep what follows it aligned
+    constexpr std::size_t HeaderBytes = alignof(std::max_align_t);
+
+    inline std::size_t& SizeOf(void* block) {
+        return *(static_cast<std::size_t*>(block) - 1);
+    }
+
+    void* Allocate(std::size_t size, std::size_t alignment) {
+        const auto header = alignment > HeaderBytes ? alignment : HeaderBytes;
+        void* base = alignment > HeaderBytes ?
+            std::aligned_alloc(alignment, (size + header + alignment - 1) / alignment * alignment) :
+            std::malloc(size + header);
+        if (base == nullptr) {
+            return nullptr;
+        }
+
+        auto* block = static_cast<char*>(base) + header;
+        SizeOf(block) = size;
+        Allocations.fetch_add(1, std::memory_order_relaxed);
+        Bytes.fetch_add(size, std::memory_order_relaxed);
+        const auto live = Live.fetch_add(size, std::memory_order_relaxed) + size;
+        auto peak = Peak.load(std::memory_order_relaxed);
+        while (live > peak && !Peak.compare_exchange_weak(peak, live, std::memory_order_relaxed)) {
+        }
+        return block;
+    }
+
+    void Free(void* block, std::size_t alignment) {
+        if (block == nullptr) {
+            return;
+        }
+        const auto header = alignment > HeaderBytes ? alignment : HeaderBytes;
+        Frees.fetch_add(1, std::memory_order_relaxed);
+        Live.fetch_sub(SizeOf(block), std::memory_order_relaxed);
+        std::free(static_cast<char*>(block) - header);
+    }
+
+    void* AllocateOrThrow(std::size_t size, std::size_t alignment) {
+        for (;;) {
+            if (auto* block = Allocate(size, alignment)) {
+                return block;
+            }
+            auto handler = std::get_new_handler();
+            if (handler == nullptr) {
+                throw std::bad_alloc();
+            }
+            handler();
+        }
+    }
+}
+
+AllocationCounters BallSimulator::CountAllocations() {
+    AllocationCounters counters;
+    counters.allocations = Allocations.load(std::memory_order_relaxed);
+    counters.frees = Frees.load(std::memory_order_relaxed);
+    counters.bytes = Bytes.load(std::memory_order_relaxed);
+    counters.live = Live.load(std::memory_order_relaxed);
+    counters.peak = Peak.load(std::memory_order_relaxed);
+    return counters;
+}
+
+void BallSimulator::ResetAllocationPeak() {
+    Peak.store(Live.load(std::memory_order_relaxed), std::memory_order_relaxed);
+}
+
+void* operator new(std::size_t size) {
+    return AllocateOrThrow(size, HeaderBytes);
+}
+
+void* operator new[](std::size_t size) {
+    return AllocateOrThrow(size, HeaderBytes);
+}
+
+void* operator new(std::size_t size, std::align_val_t alignment) {
+    return AllocateOrThrow(size, static_cast<std::size_t>(alignment));
+}
+
+void* operator new[](std::size_t size, std::align_val_t alignment) {
+    return AllocateOrThrow(size, static_cast<std::size_t>(alignment));
+}
+
+void* operator new(std::size_t size, const std::nothrow_t&) noexcept {
+    return Allocate(size, HeaderBytes);
+}
+
+void* operator new[](std::size_t size, const std::nothrow_t&) noexcept {
+    return Allocate(size, HeaderBytes);
+}
+
+void* operator new(std::size_t size, std::align_val_t alignment, const std::nothrow_t&) noexcept {
+    return Allocate(size, static_cast<std::size_t>(alignment));
+}
+
+void* operator new[](std::size_t size, std::align_val_t alignment, const std::nothrow_t&) noexcept {
+    return Allocate(size, static_cast<std::size_t>(alignment));
+}
+
+void operator delete(void* block) noexcept {
+    Free(block, HeaderBytes);
+}
+
+void operator delete[](void* block) noexcept {
+    Free(block, HeaderBytes);
+}
+
+void operator delete(void* block, std::size_t) noexcept {
+    Free(block, HeaderBytes);
+}
+
+void operator delete[](void* block, std::size_t) noexcept {
+    Free(block, HeaderBytes);
+}
+
+void operator delete(void* block, const std::nothrow_t&) noexcept {
+    Free(block, HeaderBytes);
+}
+
+void operator delete[](void* block, const std::nothrow_t&) noexcept {
+    Free(block, HeaderBytes);
+}
+
+void operator delete(void* block, std::align_val_t alignment) noexcept {
+    Free(block, static_cast<std::size_t>(alignment));
+}
+
+void operator delete[](void* block, std::align_val_t alignment) noexcept {
+    Free(block, static_cast<std::size_t>(alignment));
+}
+
+void operator delete(void* block, std::size_t, std::align_val_t alignment) noexcept {
+    Free(block, static_cast<std::size_t>(alignment));
+}
+
+void operator delete[](void* block, std::size_t, std::align_val_t alignment) noexcept {
+    Free(block, static_cast<std::size_t>(alignment));
+}
+
+void operator delete(void* block, std::align_val_t alignment, const std::nothrow_t&) noexcept {
+    Free(block, static_cast<std::size_t>(alignment));
+}
+
+void operator delete[](void* block, std::align_val_t alignment, const std::nothrow_t&) noexcept {
+    Free(block, static_cast<std::size_t>(alignment));
+}
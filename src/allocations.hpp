@@ -0,0 +1,30 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace BallSimulator {
+    // Heap use since the program started, kept by the global operator new and delete that a
+    // COUNT_ALLOCATIONS build (the BALLSIMULATOR_COUNT_ALLOCATIONS CMake option) replaces.
+    // Other builds leave the allocator alone and every counter reads zero.
+    struct AllocationCounters {
+        std::uint64_t allocations = 0;
+        std::uint64_t frees = 0;
+        std::uint64_t bytes = 0;    // asked for by all the allocations together
+        std::size_t live = 0;       // bytes allocated and not yet freed
+        std::size_t peak = 0;       // most bytes live at once since the last ResetAllocationPeak
+    };
+
+#ifdef COUNT_ALLOCATIONS
+    constexpr bool AllocationsCounted = true;
+
+    AllocationCounters CountAllocations();
+    // starts the peak again from what is live now
+    void ResetAllocationPeak();
+#else
+    constexpr bool AllocationsCounted = false;
+
+    inline AllocationCounters CountAllocations() { return {}; }
+    inline void ResetAllocationPeak() {}
+#endif
+}
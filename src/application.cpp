@@ -3,6 +3,7 @@
 
 #include "gl.h"
 #include <SDL3/SDL.h>
+#include <algorithm>
 #include <cmath>
 #include <iostream>
 
@@ -25,6 +26,35 @@ void FpsCalculator::frame(double deltaTime, void (*resultCallback)(double fps))
 }
 
 
+FixedTimestep::FixedTimestep(double stepsPerSecond, int maxSteps) :
+    _accumulator(0.0), _stepTime(1.0 / stepsPerSecond), _maxSteps(maxSteps) {
+}
+
+void FixedTimestep::set_rate(double stepsPerSecond) {
+    _stepTime = 1.0 / stepsPerSecond;
+    _accumulator = std::min(_accumulator, _stepTime);
+}
+
+int FixedTimestep::advance(double deltaTime) {
+    _accumulator += deltaTime;
+
+    int steps = static_cast<int>(_accumulator / _stepTime);
+    if (steps > _maxSteps) {
+        steps = _maxSteps;
+        _accumulator = std::fmod(_accumulator, _stepTime);
+    } else {
+        _accumulator -= steps * _stepTime;
+    }
+
+    return steps;
+}
+
+
+void Application::set_status(const std::string& status) {
+    const auto title = status.empty() ? _title : _title + " - " + status;
+    SDL_SetWindowTitle(_window, title.c_str());
+}
+
 bool Application::setup() {
     // create main window
     const SDL_WindowFlags flags = SDL_WINDOW_OPENGL | SDL_WINDOW_RESIZABLE | SDL_WINDOW_HIGH_PIXEL_DENSITY;
@@ -138,6 +168,20 @@ int Application::run() {
                 }
                 break;
 
+            case SDL_EVENT_KEY_DOWN:
+            case SDL_EVENT_KEY_UP:
+                switch (event.key.key) {
+                case SDLK_SPACE: key(Key::SPACE, event.key.down); break;
+                case SDLK_LEFT:  key(Key::LEFT, event.key.down); break;
+                case SDLK_RIGHT: key(Key::RIGHT, event.key.down); break;
+                case SDLK_UP:    key(Key::UP, event.key.down); break;
+                case SDLK_DOWN:  key(Key::DOWN, event.key.down); break;
+                case SDLK_HOME:  key(Key::HOME, event.key.down); break;
+                case SDLK_END:   key(Key::END, event.key.down); break;
+                default: break;
+                }
+                break;
+
             case SDL_EVENT_WINDOW_PIXEL_SIZE_CHANGED:
                 resize(event.window.data1, event.window.data2);
                 break;
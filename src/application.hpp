@@ -12,6 +12,24 @@ public:
     void frame(double deltaTime, void (*resultCallback)(double fps));
 };
 
+// accumulates frame time and hands out whole physics steps of a fixed length; any backlog
+// beyond maxSteps per frame is dropped so a slow frame can't snowball into slower ones
+class FixedTimestep {
+    double _accumulator;
+    double _stepTime;
+    int _maxSteps;
+
+public:
+    FixedTimestep(double stepsPerSecond, int maxSteps);
+
+    void set_rate(double stepsPerSecond);
+    int advance(double deltaTime);
+
+    [[nodiscard]] constexpr double step_time() const noexcept { return _stepTime; }
+    // fraction of a step left in the accumulator, for interpolating between the last two states
+    [[nodiscard]] constexpr double alpha() const noexcept { return _accumulator / _stepTime; }
+};
+
 typedef struct SDL_Window SDL_Window;
 typedef struct SDL_GLContextState* SDL_GLContext;
 
@@ -25,6 +43,10 @@ public:
         LEFT, RIGHT, MIDDLE
     };
 
+    enum class Key {
+        SPACE, LEFT, RIGHT, UP, DOWN, HOME, END
+    };
+
     Application(int width, int height, std::string&& title, SwapInterval swap = SwapInterval::VSYNC)
         : _initialWidth(width), _initialHeight(height), _title(std::forward<std::string>(title)), _swap(swap) {};
     virtual ~Application() = default;
@@ -48,6 +70,11 @@ protected:
 
     virtual void resize(int width, int height);
     virtual void mouse(MouseButton button, bool pressed) = 0;
+    // only keys listed in Key are passed on, and held keys repeat as further presses
+    virtual void key(Key, bool) {}
+
+    // shows status after the title in the window's title bar, or just the title when empty
+    void set_status(const std::string& status);
 
 private:
     const std::string _title;
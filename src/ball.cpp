@@ -5,52 +5,84 @@
 
 using namespace BallSimulator;
 
-void Ball::update(const World& world, float deltaTime) {
-    _velocity.y += world.gravity() * deltaTime;
-    set_position(_position + _velocity * deltaTime);
-}
-
-bool Ball::collide(Ball& other) {
-    float totalRadius = radius() + other.radius();
-    vec2f delta = get_position() - other.get_position();
-    float distance2 = delta.length2();
-    if (distance2 == 0.0f || totalRadius * totalRadius < distance2) {
-        return false;
-    }
+namespace {
+    // what a contact does to a pair of balls: the first moves by push * shareA and, if they
+    // are still approaching, gains impulse * inverseMassA; the second gets the same with the
+    // sign flipped and its own share
+    struct ContactResponse {
+        vec2f push;
+        vec2f impulse;
+        float inverseMassA, inverseMassB;
+        float shareA, shareB;
+        bool approaching;
+    };
 
-    other.collisionFlash = collisionFlash = COLLISION_FLASH_DURATION;
+    // false if a and b don't touch
+    bool Respond(const Ball& a, const Ball& b, ContactResponse& response) {
+        float totalRadius = a.radius() + b.radius();
+        vec2f delta = a.get_position() - b.get_position();
+        float distance2 = delta.length2();
+        if (distance2 == 0.0f || totalRadius * totalRadius < distance2) {
+            return false;
+        }
 
-    // calculate intersection depth and normal
-    float distance = std::sqrt(distance2);
-    vec2f normal = delta / distance;
-    float intersectDepth = totalRadius - distance;
-    vec2f pushDirection = normal * intersectDepth + Epsilon;
+        // calculate intersection depth and normal
+        float distance = std::sqrt(distance2);
+        vec2f normal = delta / distance;
+        float intersectDepth = totalRadius - distance;
+        vec2f pushDirection = normal * intersectDepth + Epsilon;
 
-    float inverseMassA = 1.0f / mass();
-    float inverseMassB = 1.0f / other.mass();
+        response.inverseMassA = 1.0f / a.mass();
+        response.inverseMassB = 1.0f / b.mass();
 #ifndef SIMULATION_LOSSES
-    const float inverseMassScale = 1.0f / (inverseMassA + inverseMassB);
+        const float inverseMassScale = 1.0f / (response.inverseMassA + response.inverseMassB);
 #else
-    constexpr float inverseMassScale = 1.0f;  // disabling rescaling induces losses and may be more realistic
+        constexpr float inverseMassScale = 1.0f;  // disabling rescaling induces losses and may be more realistic
 #endif
+        response.push = pushDirection;
+        response.shareA = response.inverseMassA * inverseMassScale;
+        response.shareB = response.inverseMassB * inverseMassScale;
 
-    // push balls out of each other
-    set_position(_position + pushDirection * (inverseMassA * inverseMassScale));
-    other.set_position(other.get_position() - pushDirection * (inverseMassB * inverseMassScale));
-
-    auto impactSpeed = _velocity - other._velocity;
-    auto velocityNumber = vec2f::dot(impactSpeed, normal);
+        auto impactSpeed = a.get_velocity() - b.get_velocity();
+        auto velocityNumber = vec2f::dot(impactSpeed, normal);
+        response.approaching = velocityNumber <= 0.0f;
 
-    if (velocityNumber > 0.0f) {
+        // velocity response
+        auto impulseFactor = -2.0f * velocityNumber * inverseMassScale * IMPULSE_MULTIPLIER;
+        response.impulse = normal * impulseFactor;
         return true;
     }
+}
 
-    // compute and apply velocity response
-    auto impulseFactor = -2.0f * velocityNumber * inverseMassScale * IMPULSE_MULTIPLIER;
-    vec2f impulse = normal * impulseFactor;
-    _velocity += impulse * inverseMassA;
-    other.set_velocity(other._velocity - impulse * inverseMassB);
+bool Ball::collide(Ball& other) {
+    ContactResponse response;
+    if (!Respond(*this, other, response)) {
+        return false;
+    }
 
+    other.collisionFlash = collisionFlash = COLLISION_FLASH_DURATION;
+
+    // push balls out of each other
+    set_position(_position + response.push * response.shareA);
+    other.set_position(other._position - response.push * response.shareB);
+    if (response.approaching) {
+        _velocity += response.impulse * response.inverseMassA;
+        other.set_velocity(other._velocity - response.impulse * response.inverseMassB);
+    }
+    return true;
+}
+
+bool Ball::collide_one_sided(const Ball& other) {
+    ContactResponse response;
+    if (!Respond(*this, other, response)) {
+        return false;
+    }
+
+    collisionFlash = COLLISION_FLASH_DURATION;
+    set_position(_position + response.push * response.shareA);
+    if (response.approaching) {
+        _velocity += response.impulse * response.inverseMassA;
+    }
     return true;
 }
 
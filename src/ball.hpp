@@ -18,10 +18,10 @@ namespace BallSimulator {
 
         Ball(float mass, float radius, const vec2f& position = vec2f::zero(), const vec2f& velocity = vec2f::zero()) :
             _mass(mass), _radius(radius), _position(position), _velocity(velocity) {}
-        constexpr Ball(const Ball& other) :
-            _mass(other._mass), _radius(other._radius), _position(other._position), _velocity(other._velocity) {}
-        constexpr Ball(Ball&& other) : _mass(other._mass), _radius(other._radius),
-            _position(std::move(other._position)), _velocity(std::move(other._velocity)) {}
+        constexpr Ball(const Ball& other) = default;
+        constexpr Ball(Ball&& other) = default;
+        constexpr Ball& operator =(const Ball& other) = default;
+        constexpr Ball& operator =(Ball&& other) = default;
 
         inline constexpr float mass() const { return _mass; }
         inline constexpr float radius() const { return _radius; }
@@ -36,8 +36,10 @@ namespace BallSimulator {
 
         inline constexpr Rectangle<float> rect() const { return Rectangle<float>(_position, _radius * 2.0f); }
 
-        void update(const World& world, float deltaTime);
         bool collide(Ball& other);
+        // for pairs split across threads or processes: other is a read-only copy whose owner
+        // applies the mirrored half of the response
+        bool collide_one_sided(const Ball& other);
         void apply_world_boundary(const World& world);
     };
 }
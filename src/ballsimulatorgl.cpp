@@ -3,7 +3,11 @@
 
 #include <chrono>
 #include <algorithm>
+#include <cmath>
 #include <iostream>
+#include <limits>
+#include <sstream>
+#include <utility>
 
 gfx::Mesh BallSimulatorGl::generate_filled_circle(gfx::Renderer& render, float radius) {
     constexpr int triangleFanCount = GL_DRAW_CIRCLE_TRIANGLE_AMOUNT;
@@ -47,14 +51,12 @@ gfx::Mesh BallSimulatorGl::generate_filled_rect(gfx::Renderer& render, const Ext
 }
 
 
-BallSimulatorGl::BallSimulatorGl() :
-    Application(1024, 1024, "Ball Simulation") {
+BallSimulatorGl::BallSimulatorGl(double stepsPerSecond) :
+    Application(1024, 1024, "Ball Simulation"),
+    physicsClock(stepsPerSecond, PHYSICS_MAX_STEPS_PER_FRAME) {
 }
 
 bool BallSimulatorGl::init() {
-    srand(static_cast<unsigned int>(std::chrono::duration_cast<std::chrono::seconds>
-        (std::chrono::system_clock::now().time_since_epoch()).count()));
-
     // setup world
     world.resize(static_cast<Rectangle<float>>(get_frame()));
 #ifdef SIMULATION_GRAVITY
@@ -81,15 +83,30 @@ bool BallSimulatorGl::init() {
         return false;
     }
 
+    simulationRunning = true;
+    simulationThread = trajectory != nullptr ?
+        std::thread(&BallSimulatorGl::play, this) : std::thread(&BallSimulatorGl::simulate, this);
+
     return true;
 }
 
 void BallSimulatorGl::quit() {
+    simulationRunning = false;
+    if (simulationThread.joinable()) {
+        simulationThread.join();
+    }
+
     renderer().delete_mesh(quadMesh);
     renderer().delete_mesh(rectMesh);
     renderer().delete_mesh(ballMesh);
 }
 
+namespace {
+    inline double ClockSeconds() {
+        return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+}
+
 void BallSimulatorGl::render(double deltaTime) {
     using namespace gfx;
 
@@ -97,64 +114,60 @@ void BallSimulatorGl::render(double deltaTime) {
         std::cerr << "FPS: " << fps << std::endl;
     });
 
-#ifdef USE_QUADTREES
-    BallSimulator::DoQuadtreeCollisionDetection(world, static_cast<float>(deltaTime));
-#else
-    BallSimulator::DoSimpleCollisionDetection(world, static_cast<float>(deltaTime));
-#endif
+    snapshots.update();
+    const auto& snapshot = snapshots.front();
 
-    // build instance lists
-    ballInstances.reserve(world.entities().size());
-    for (auto& ball : world.entities()) {
+    // build instance lists, blending between the last two physics states
+    auto alpha = 1.0f;
+    if (snapshot.stepTime > 0.0) {
+        alpha = static_cast<float>(std::clamp((ClockSeconds() - snapshot.timestamp) / snapshot.stepTime, 0.0, 1.0));
+    }
+    // replays are fitted to the window, whatever size of world they were recorded in
+    auto scale = 1.0f;
+    auto offset = vec2f::zero();
+    if (replayBounds) {
+        const auto frame = get_frame();
+        scale = std::min(static_cast<float>(frame.w) / replayBounds->w, static_cast<float>(frame.h) / replayBounds->h);
+        offset = vec2f(static_cast<float>(frame.w) - replayBounds->w * scale, static_cast<float>(frame.h) - replayBounds->h * scale) * 0.5f -
+            vec2f(replayBounds->x, replayBounds->y) * scale;
+    }
+    ballInstances.reserve(snapshot.positions.size());
+    for (std::size_t i = 0; i < snapshot.positions.size(); i++) {
         Instance instance;
-        instance.position = ball->get_position();
-        instance.scale = vec2f(ball->radius());
-        if (ball->collisionFlash > 0) {
-            instance.color = color::yellow();
-            --ball->collisionFlash;
-        } else {
-            instance.color = color::red();
+        instance.position = snapshot.positions[i];
+        if (i < snapshot.previous.size()) {
+            const auto& previous = snapshot.previous[i];
+            instance.position = previous + (instance.position - previous) * alpha;
         }
+        instance.position = offset + instance.position * scale;
+        instance.scale = vec2f(snapshot.radii[i] * scale);
+        instance.color = snapshot.flash[i] ? color::yellow() : color::red();
         ballInstances.emplace_back(instance);
     }
 
-    const auto build_quadtree_vis_instances = [this](const BallSimulator::CollisionQuadtree& tree) {
-        static auto& quads = quadInstances;
-#ifdef SHOW_QUADTREE_HEATMAP
-        static auto& rects = rectInstances;
-#endif
-        static void (*inner)(const BallSimulator::CollisionQuadtree&) =
-                [](const BallSimulator::CollisionQuadtree& innerTree) {
-
-            const auto& bounds = innerTree.bounds();
-            if (innerTree.has_child_nodes()) {
-                quads.push_back({
-                    .position = bounds.position(),
-                    .scale = bounds.size(),
-                    .color = color::blue()
-                });
-                innerTree.for_each_node<decltype(inner)>(inner);
-            }
+    for (const auto& bounds : snapshot.quads) {
+        quadInstances.push_back({
+            .position = bounds.position(),
+            .scale = bounds.size(),
+            .color = color::blue()
+        });
+    }
 #ifdef SHOW_QUADTREE_HEATMAP
-            else if (!innerTree.objects().empty()) {
-                auto rescale = [](float x, float lin, float exp) {
-                    return std::max(x * lin, x * (1.0f - exp) + x * x * exp);
-                };
-
-                float normalisedCount = static_cast<float>(innerTree.objects().size()) / QUADTREE_MAX_OBJECTS;
-                float alpha = 0.4f * rescale(normalisedCount, 0.45f, 1.6f);
-
-                rects.push_back({
-                    .position = bounds.position(),
-                    .scale = bounds.size(),
-                    .color = color::black().mix(color::cyan(), alpha)
-                });
-            }
-#endif
+    for (const auto& cell : snapshot.cells) {
+        auto rescale = [](float x, float lin, float exp) {
+            return std::max(x * lin, x * (1.0f - exp) + x * x * exp);
         };
-        inner(tree);
-    };
-    build_quadtree_vis_instances(world.quadtree());
+
+        float normalisedCount = static_cast<float>(cell.count) / QUADTREE_MAX_OBJECTS;
+        float heat = 0.4f * rescale(normalisedCount, 0.45f, 1.6f);
+
+        rectInstances.push_back({
+            .position = cell.bounds.position(),
+            .scale = cell.bounds.size(),
+            .color = color::black().mix(color::cyan(), heat)
+        });
+    }
+#endif
 
     // draw everything
     renderer().new_frame();
@@ -174,18 +187,266 @@ void BallSimulatorGl::render(double deltaTime) {
     quadInstances.clear();
 }
 
+void BallSimulatorGl::simulate() {
+    typedef std::chrono::steady_clock clock;
+    auto lastTime = clock::now();
+
+    while (simulationRunning.load(std::memory_order_relaxed)) {
+        apply_requests();
+
+        const auto currentTime = clock::now();
+        const auto steps = physicsClock.advance(std::chrono::duration<double>(currentTime - lastTime).count());
+        lastTime = currentTime;
+
+        if (steps == 0) {
+            // nothing due yet, so sleep until the next step is
+            const auto remaining = physicsClock.step_time() * (1.0 - physicsClock.alpha());
+            std::this_thread::sleep_for(std::chrono::duration<double>(remaining));
+            continue;
+        }
+
+        auto& entities = world.entities();
+        for (auto i = 0; i < steps; i++) {
+            // only the state before the final step is needed for interpolation
+            if (i == steps - 1) {
+                auto& previous = snapshots.back().previous;
+                previous.resize(entities.size());
+                for (std::size_t j = 0; j < entities.size(); j++) {
+                    previous[j] = entities[j].get_position();
+                }
+            }
+
+#ifdef USE_QUADTREES
+            BallSimulator::DoAdaptiveStep(world, static_cast<float>(physicsClock.step_time()),
+                BallSimulator::DoQuadtreeCollisionDetection);
+#else
+            BallSimulator::DoAdaptiveStep(world, static_cast<float>(physicsClock.step_time()),
+                BallSimulator::DoSimpleCollisionDetection);
+#endif
+
+            for (auto& ball : entities) {
+                if (ball.collisionFlash > 0) {
+                    --ball.collisionFlash;
+                }
+            }
+        }
+
+        publish_snapshot(ClockSeconds());
+    }
+}
+
+void BallSimulatorGl::play() {
+    typedef std::chrono::steady_clock clock;
+    auto lastTime = clock::now();
+
+    // recordings without a frame time play at the physics rate
+    const auto frameTime = trajectory->frame_time() > 0.0f ?
+        static_cast<double>(trajectory->frame_time()) : physicsClock.step_time();
+    const auto lastFrame = static_cast<double>(trajectory->frames() > 0 ? trajectory->frames() - 1 : 0);
+    const auto chunks = trajectory->chunks();
+    const auto firstFrame = [](const BallSimulator::TrajectoryIndexEntry& entry) { return entry.firstFrame; };
+
+    auto position = 0.0;
+    auto shown = std::numeric_limits<std::uint64_t>::max();
+    while (simulationRunning.load(std::memory_order_relaxed)) {
+        double speed;
+        bool paused;
+        std::optional<std::uint64_t> seek;
+        int keyframes;
+        {
+            std::lock_guard lock(requestMutex);
+            speed = playbackSpeed;
+            paused = playbackPaused;
+            seek.swap(pendingSeek);
+            keyframes = std::exchange(pendingKeyframes, 0);
+        }
+
+        const auto currentTime = clock::now();
+        if (!paused) {
+            position += std::chrono::duration<double>(currentTime - lastTime).count() / frameTime * speed;
+        }
+        lastTime = currentTime;
+
+        // every chunk starts with a keyframe, so seeking goes from one chunk start to the next
+        const auto jumped = seek.has_value() || keyframes != 0;
+        if (seek) {
+            position = static_cast<double>(*seek);
+        }
+        for (; keyframes > 0; keyframes--) {
+            const auto next = std::ranges::upper_bound(chunks, static_cast<std::uint64_t>(position), {}, firstFrame);
+            if (next != std::end(chunks)) {
+                position = static_cast<double>(next->firstFrame);
+            }
+        }
+        for (; keyframes < 0; keyframes++) {
+            const auto next = std::ranges::lower_bound(chunks, static_cast<std::uint64_t>(position), {}, firstFrame);
+            if (next != std::begin(chunks)) {
+                position = static_cast<double>(std::prev(next)->firstFrame);
+            }
+        }
+        position = std::clamp(position, 0.0, lastFrame);
+
+        // a dropped frame just leaves the one before on screen
+        const auto target = static_cast<std::uint64_t>(position);
+        if (target != shown) {
+            const auto values = trajectory->frame(target);
+            if (!values.empty()) {
+                publish_frame(values, !jumped && target > shown, frameTime / speed);
+                shown = target;
+            }
+        }
+
+        if (paused || position >= lastFrame) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        } else {
+            const auto remaining = (std::floor(position) + 1.0 - position) * frameTime / speed;
+            std::this_thread::sleep_for(std::chrono::duration<double>(remaining));
+        }
+    }
+}
+
+void BallSimulatorGl::publish_frame(std::span<const float> values, bool continuous, double stepTime) {
+    auto& snapshot = snapshots.back();
+    const auto balls = values.size() / BallSimulator::TrajectoryColumns;
+
+    // only a frame that follows on from the last one is worth interpolating towards
+    snapshot.previous.clear();
+    if (continuous) {
+        snapshot.previous.assign(std::begin(replayPositions), std::end(replayPositions));
+    }
+    replayPositions.resize(balls);
+    for (std::size_t i = 0; i < balls; i++) {
+        replayPositions[i] = vec2f(values[i * BallSimulator::TrajectoryColumns], values[i * BallSimulator::TrajectoryColumns + 1]);
+    }
+    snapshot.positions.assign(std::begin(replayPositions), std::end(replayPositions));
+
+    // sizes never change over a recording, so each buffer only needs them once
+    if (snapshot.radii.size() != balls) {
+        const auto radii = trajectory->radii();
+        snapshot.radii.assign(std::begin(radii), std::end(radii));
+    }
+    snapshot.flash.assign(balls, 0);
+    snapshot.quads.clear();
+    snapshot.cells.clear();
+
+    snapshot.timestamp = ClockSeconds();
+    snapshot.stepTime = stepTime;
+    snapshots.publish();
+}
+
+void BallSimulatorGl::apply_requests() {
+    std::optional<Rectangle<float>> resize;
+    {
+        std::lock_guard lock(requestMutex);
+        resize.swap(pendingResize);
+        for (auto& ball : pendingBalls) {
+            world.add(ball);
+        }
+        pendingBalls.clear();
+    }
+
+    if (resize) {
+        world.resize(*resize);
+        world.scatter();
+    }
+}
+
+void BallSimulatorGl::publish_snapshot(double timestamp) {
+    auto& snapshot = snapshots.back();
+    const auto& entities = world.entities();
+
+    snapshot.positions.resize(entities.size());
+    snapshot.radii.resize(entities.size());
+    snapshot.flash.resize(entities.size());
+    for (std::size_t i = 0; i < entities.size(); i++) {
+        snapshot.positions[i] = entities[i].get_position();
+        snapshot.radii[i] = entities[i].radius();
+        snapshot.flash[i] = entities[i].collisionFlash > 0 ? 1 : 0;
+    }
+
+    snapshot.quads.clear();
+    snapshot.cells.clear();
+    const auto walk = [&snapshot](const auto& self, const BallSimulator::CollisionQuadtree& tree) -> void {
+        if (tree.has_child_nodes()) {
+            snapshot.quads.push_back(tree.bounds());
+            tree.for_each_node([&](const BallSimulator::CollisionQuadtree& child) {
+                self(self, child);
+            });
+        } else if (!tree.objects().empty()) {
+            snapshot.cells.push_back({ tree.bounds(), static_cast<std::uint32_t>(tree.objects().size()) });
+        }
+    };
+    walk(walk, world.quadtree());
+
+    snapshot.timestamp = timestamp;
+    snapshot.stepTime = physicsClock.step_time();
+    snapshots.publish();
+}
+
 void BallSimulatorGl::resize(int width, int height) {
     Application::resize(width, height);
     std::cerr << "Window Size: " << width << "x" << height << std::endl;
-    world.resize({ 0.0f, 0.0f, static_cast<float>(width), static_cast<float>(height) });
-    world.scatter();
+
+    std::lock_guard lock(requestMutex);
+    pendingResize = Rectangle<float>(0.0f, 0.0f, static_cast<float>(width), static_cast<float>(height));
 }
 
 void BallSimulatorGl::mouse(MouseButton button, bool pressed) {
-    if (button == MouseButton::LEFT && pressed) {
+    if (button == MouseButton::LEFT && pressed && !replayBounds) {
         BallSimulator::Ball ball(5.0f, 20.0f);
         ball.set_position(static_cast<vec2f>(get_cursor_pos()));
         ball.set_velocity(vec2f(10.0f, 10.0f));
-        world.add(ball);
+
+        std::lock_guard lock(requestMutex);
+        pendingBalls.push_back(ball);
+    }
+}
+
+void BallSimulatorGl::key(Key key, bool pressed) {
+    if (!pressed || !replayBounds) {
+        return;
     }
+
+    std::unique_lock lock(requestMutex);
+    const auto speed = playbackSpeed;
+    const auto paused = playbackPaused;
+    switch (key) {
+        case Key::SPACE: playbackPaused = !playbackPaused; break;
+        case Key::LEFT:  pendingKeyframes--; break;
+        case Key::RIGHT: pendingKeyframes++; break;
+        case Key::UP:    playbackSpeed = std::min(playbackSpeed * 2.0, PLAYBACK_MAX_SPEED); break;
+        case Key::DOWN:  playbackSpeed = std::max(playbackSpeed * 0.5, 1.0 / PLAYBACK_MAX_SPEED); break;
+        case Key::HOME:  pendingSeek = 0; break;
+        case Key::END:   pendingSeek = std::numeric_limits<std::uint64_t>::max(); break;
+    }
+    if (playbackSpeed == speed && playbackPaused == paused) {
+        return;
+    }
+
+    std::ostringstream status;
+    status << "Playback " << playbackSpeed << "x" << (playbackPaused ? ", paused" : "");
+    lock.unlock();
+    set_status(status.str());
+}
+
+bool BallSimulatorGl::load_trajectory(const std::string& path) {
+    std::string error;
+    trajectory = BallSimulator::TrajectoryReader::open(path, error);
+    if (trajectory == nullptr) {
+        std::cerr << "Can't replay " << path << ": " << error << std::endl;
+        return false;
+    }
+    replayBounds = trajectory->bounds();
+    std::cerr << "Replaying " << trajectory->balls() << " balls over " << trajectory->frames() << " frames in " <<
+        trajectory->chunks().size() << " chunks" << std::endl;
+    return true;
+}
+
+void BallSimulatorGl::set_playback_speed(double speed) {
+    std::lock_guard lock(requestMutex);
+    playbackSpeed = std::clamp(speed, 1.0 / PLAYBACK_MAX_SPEED, PLAYBACK_MAX_SPEED);
+}
+
+void BallSimulatorGl::set_physics_rate(double stepsPerSecond) {
+    physicsClock.set_rate(stepsPerSecond);
 }
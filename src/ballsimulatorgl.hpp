@@ -2,12 +2,44 @@
 
 #include "application.hpp"
 #include "world.hpp"
+#include "snapshot.hpp"
+#include "triplebuffer.hpp"
+#include "trajectoryreader.hpp"
 #include "config.h"
 
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <span>
+#include <string>
+#include <thread>
+
 class BallSimulatorGl final : public Application {
     FpsCalculator fpscalc;
+    FixedTimestep physicsClock;
 
+    // the world belongs to the simulation thread while it runs; the render thread only sees
+    // the snapshots it publishes and talks back through the pending requests below
     BallSimulator::World world;
+    std::thread simulationThread;
+    std::atomic<bool> simulationRunning{ false };
+    TripleBuffer<SimulationSnapshot> snapshots;
+
+    std::mutex requestMutex;
+    std::vector<BallSimulator::Ball> pendingBalls;
+    std::optional<Rectangle<float>> pendingResize;
+
+    // set when replaying a recording instead of simulating. the reader belongs to the replay
+    // thread, which runs in place of the simulation thread; playback is steered through the
+    // requests, which like the ones above are guarded by requestMutex
+    std::unique_ptr<BallSimulator::TrajectoryReader> trajectory;
+    std::optional<Rectangle<float>> replayBounds;
+    std::vector<vec2f> replayPositions;
+    double playbackSpeed = 1.0;
+    bool playbackPaused = false;
+    std::optional<std::uint64_t> pendingSeek;
+    int pendingKeyframes = 0;
 
     gfx::Mesh ballMesh, rectMesh, quadMesh;
 
@@ -21,6 +53,13 @@ class BallSimulatorGl final : public Application {
 
     void render_quadtree_bounds();
 
+    void simulate();
+    void apply_requests();
+    void publish_snapshot(double timestamp);
+
+    void play();
+    void publish_frame(std::span<const float> values, bool continuous, double stepTime);
+
     virtual bool init();
     virtual void quit();
 
@@ -28,9 +67,17 @@ class BallSimulatorGl final : public Application {
 
     virtual void resize(int width, int height);
     virtual void mouse(MouseButton button, bool pressed);
+    virtual void key(Key key, bool pressed);
 
 public:
-    BallSimulatorGl();
+    explicit BallSimulatorGl(double stepsPerSecond = PHYSICS_STEP_RATE);
     virtual ~BallSimulatorGl() = default;
+
+    // plays the trajectory at path instead of simulating; call before run()
+    bool load_trajectory(const std::string& path);
+    // recorded frames shown per frame time of the recording
+    void set_playback_speed(double speed);
+    // physics steps simulated per second of wall time; call before run()
+    void set_physics_rate(double stepsPerSecond);
 };
 
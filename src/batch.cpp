@@ -0,0 +1,249 @@
+#include "batch.hpp"
+#include "world.hpp"
+#include "ball.hpp"
+
+#include <algorithm>
+#include <bit>
+#include <cmath>
+#include <limits>
+
+using namespace BallSimulator;
+
+namespace {
+    constexpr auto Lanes = WorldBatch::Lanes;
+    typedef WorldBatch::Block Block;
+
+    // the lane loops below all have a fixed trip count and no branches, so the compiler turns
+    // them into vector code; misses are handled by selecting the old value, never by skipping.
+    // a plain ?: tends to get turned back into a branch around the store, so selects are done
+    // on the bits instead
+    inline float Select(bool condition, float a, float b) {
+        const auto mask = 0u - static_cast<std::uint32_t>(condition);
+        return std::bit_cast<float>((std::bit_cast<std::uint32_t>(a) & mask) | (std::bit_cast<std::uint32_t>(b) & ~mask));
+    }
+
+    inline std::int32_t Select(bool condition, std::int32_t a, std::int32_t b) {
+        const auto mask = 0 - static_cast<std::int32_t>(condition);
+        return (a & mask) | (b & ~mask);
+    }
+
+    // mirrors Ball::collide for ball a against ball b in every lane
+    inline void CollideLanes(Block& __restrict a, Block& __restrict b) {
+        for (std::size_t lane = 0; lane < Lanes; lane++) {
+            const auto x1 = a.x[lane], y1 = a.y[lane], vx1 = a.vx[lane], vy1 = a.vy[lane];
+            const auto x2 = b.x[lane], y2 = b.y[lane], vx2 = b.vx[lane], vy2 = b.vy[lane];
+            const auto inverseMassA = a.inverseMass[lane];
+            const auto inverseMassB = b.inverseMass[lane];
+
+            const auto totalRadius = a.radius[lane] + b.radius[lane];
+            const auto dx = x1 - x2;
+            const auto dy = y1 - y2;
+            const auto distance2 = dx * dx + dy * dy;
+            const bool hit = (distance2 != 0.0f) & !(totalRadius * totalRadius < distance2);
+
+            const auto distance = std::sqrt(Select(hit, distance2, 1.0f));
+            const auto inverseDistance = 1.0f / distance;
+            const auto nx = dx * inverseDistance;
+            const auto ny = dy * inverseDistance;
+            const auto intersectDepth = totalRadius - distance;
+            const auto pushX = nx * intersectDepth + Epsilon;
+            const auto pushY = ny * intersectDepth + Epsilon;
+
+#ifndef SIMULATION_LOSSES
+            const float inverseMassScale = 1.0f / (inverseMassA + inverseMassB);
+#else
+            constexpr float inverseMassScale = 1.0f;
+#endif
+            const auto pushA = inverseMassA * inverseMassScale;
+            const auto pushB = inverseMassB * inverseMassScale;
+
+            a.flash[lane] = Select(hit, COLLISION_FLASH_DURATION, a.flash[lane]);
+            b.flash[lane] = Select(hit, COLLISION_FLASH_DURATION, b.flash[lane]);
+            a.x[lane] = Select(hit, x1 + pushX * pushA, x1);
+            a.y[lane] = Select(hit, y1 + pushY * pushA, y1);
+            b.x[lane] = Select(hit, x2 - pushX * pushB, x2);
+            b.y[lane] = Select(hit, y2 - pushY * pushB, y2);
+
+            const auto velocityNumber = (vx1 - vx2) * nx + (vy1 - vy2) * ny;
+            const bool respond = hit & !(velocityNumber > 0.0f);
+            const auto impulseFactor = -2.0f * velocityNumber * inverseMassScale * IMPULSE_MULTIPLIER;
+            const auto impulseX = nx * impulseFactor;
+            const auto impulseY = ny * impulseFactor;
+
+            a.vx[lane] = Select(respond, vx1 + impulseX * inverseMassA, vx1);
+            a.vy[lane] = Select(respond, vy1 + impulseY * inverseMassA, vy1);
+            b.vx[lane] = Select(respond, vx2 - impulseX * inverseMassB, vx2);
+            b.vy[lane] = Select(respond, vy2 - impulseY * inverseMassB, vy2);
+        }
+    }
+
+    // mirrors Ball::apply_world_boundary in every lane
+    inline void ApplyBoundaryLanes(Block& __restrict ball, const float* __restrict width, const float* __restrict height) {
+        for (std::size_t lane = 0; lane < Lanes; lane++) {
+            const auto x = ball.x[lane], y = ball.y[lane], vx = ball.vx[lane], vy = ball.vy[lane];
+            const auto radius = ball.radius[lane];
+#ifdef SIMULATION_LOSSES
+            const auto inverseMass = ball.inverseMass[lane];
+#else
+            constexpr float inverseMass = 1.0f;
+#endif
+
+            const bool left = x - radius < Epsilon;
+            const bool right = !left & (x + radius > width[lane]);
+            ball.x[lane] = Select(left, radius, Select(right, width[lane] - radius, x));
+            ball.vx[lane] = Select(left | right, -vx * inverseMass, vx);
+
+            const bool top = y - radius < Epsilon;
+            const bool bottom = !top & (y + radius > height[lane]);
+            ball.y[lane] = Select(top, radius, Select(bottom, height[lane] - radius, y));
+            ball.vy[lane] = Select(top | bottom, -vy * inverseMass, vy);
+
+            ball.flash[lane] = Select(left | right | top | bottom, COLLISION_FLASH_DURATION, ball.flash[lane]);
+        }
+    }
+
+    // calls f(x, y, vx, vy, gravity) for every lane of every block
+    template <typename F>
+    inline void ForEachLane(std::span<Block> blocks, const float* __restrict gravity, F&& f) {
+        for (auto& block : blocks) {
+            for (std::size_t lane = 0; lane < Lanes; lane++) {
+                f(block.x[lane], block.y[lane], block.vx[lane], block.vy[lane], gravity[lane]);
+            }
+        }
+    }
+}
+
+bool WorldBatch::load(std::span<const World> worlds) {
+    if (worlds.empty() || worlds.size() > Lanes) {
+        return false;
+    }
+    for (const auto& world : worlds) {
+        if (world.entities().size() != worlds.front().entities().size() ||
+            world.integrator() != worlds.front().integrator()) {
+            return false;
+        }
+    }
+
+    _worlds = worlds.size();
+    _integrator = worlds.front().integrator();
+    _substepPolicy = worlds.front().substep_policy();
+    _blocks.resize(worlds.front().entities().size());
+
+    for (std::size_t lane = 0; lane < Lanes; lane++) {
+        const auto& world = worlds[std::min(lane, _worlds - 1)];
+        _gravity[lane] = world.gravity();
+        _width[lane] = world.width();
+        _height[lane] = world.height();
+
+        const auto& entities = world.entities();
+        for (std::size_t i = 0; i < _blocks.size(); i++) {
+            auto& block = _blocks[i];
+            const auto& ball = entities[i];
+            block.x[lane] = ball.get_position().x;
+            block.y[lane] = ball.get_position().y;
+            block.vx[lane] = ball.get_velocity().x;
+            block.vy[lane] = ball.get_velocity().y;
+            block.radius[lane] = ball.radius();
+            block.inverseMass[lane] = 1.0f / ball.mass();
+            block.flash[lane] = ball.collisionFlash;
+        }
+    }
+    return true;
+}
+
+void WorldBatch::store(std::span<World> worlds) const {
+    for (std::size_t lane = 0; lane < std::min(worlds.size(), _worlds); lane++) {
+        auto& entities = worlds[lane].entities();
+        for (std::size_t i = 0; i < std::min(entities.size(), _blocks.size()); i++) {
+            const auto& block = _blocks[i];
+            entities[i].set_position(block.x[lane], block.y[lane]);
+            entities[i].set_velocity(block.vx[lane], block.vy[lane]);
+            entities[i].collisionFlash = block.flash[lane];
+        }
+    }
+}
+
+void WorldBatch::integrate(float deltaTime) {
+    // same arithmetic, in the same order, as the kernels in integrator.cpp
+    const auto halfDeltaTime = 0.5f * deltaTime;
+    const auto halfDeltaTime2 = 0.5f * deltaTime * deltaTime;
+
+    switch (_integrator) {
+        case Integrator::EXPLICIT_EULER:
+            ForEachLane(_blocks, _gravity.data(), [&](float& x, float& y, float& vx, float& vy, float g) {
+                x = x + vx * deltaTime;
+                y = y + vy * deltaTime;
+                vy = vy + g * deltaTime;
+            });
+            break;
+        case Integrator::SYMPLECTIC_EULER:
+            ForEachLane(_blocks, _gravity.data(), [&](float& x, float& y, float& vx, float& vy, float g) {
+                vy = vy + g * deltaTime;
+                x = x + vx * deltaTime;
+                y = y + vy * deltaTime;
+            });
+            break;
+        case Integrator::VELOCITY_VERLET:
+            ForEachLane(_blocks, _gravity.data(), [&](float& x, float& y, float& vx, float& vy, float g) {
+                x = x + vx * deltaTime;
+                y = y + vy * deltaTime + g * halfDeltaTime2;
+                vy = vy + g * deltaTime;
+            });
+            break;
+        case Integrator::POSITION_VERLET:
+            ForEachLane(_blocks, _gravity.data(), [&](float& x, float& y, float& vx, float& vy, float g) {
+                x = x + vx * halfDeltaTime;
+                y = y + vy * halfDeltaTime;
+                vy = vy + g * deltaTime;
+                x += vx * halfDeltaTime;
+                y += vy * halfDeltaTime;
+            });
+            break;
+    }
+}
+
+void WorldBatch::collide() {
+    for (std::size_t i = 0; i < _blocks.size(); i++) {
+        for (auto j = i + 1; j < _blocks.size(); j++) {
+            CollideLanes(_blocks[i], _blocks[j]);
+        }
+        ApplyBoundaryLanes(_blocks[i], _width.data(), _height.data());
+    }
+}
+
+StepInfo WorldBatch::step(float deltaTime) {
+    const auto scaledDeltaTime = static_cast<float>(deltaTime * SIMULATION_TIMESCALE);
+
+    StepInfo info{ 1, deltaTime, 0.0f };
+    for (std::size_t lane = 0; lane < _worlds; lane++) {
+        float maxSpeed2 = 0.0f;
+        float minRadius = std::numeric_limits<float>::max();
+        for (const auto& block : _blocks) {
+            maxSpeed2 = std::max(maxSpeed2, block.vx[lane] * block.vx[lane] + block.vy[lane] * block.vy[lane]);
+            minRadius = std::min(minRadius, block.radius[lane]);
+        }
+        if (minRadius <= 0.0f || minRadius == std::numeric_limits<float>::max()) {
+            continue;
+        }
+
+        const auto maxSpeed = std::sqrt(maxSpeed2) + std::abs(_gravity[lane]) * scaledDeltaTime;
+        info.maxVelocityRatio = std::max(info.maxVelocityRatio, maxSpeed / minRadius);
+    }
+
+    if (info.maxVelocityRatio > 0.0f) {
+        const auto maxDisplacement = std::max(_substepPolicy.maxDisplacement, Epsilon);
+        const auto required = std::ceil(info.maxVelocityRatio * scaledDeltaTime / maxDisplacement);
+        info.substeps = std::clamp(static_cast<int>(std::min(required, static_cast<float>(_substepPolicy.maxSubsteps))),
+            1, std::max(_substepPolicy.maxSubsteps, 1));
+        info.deltaTime = deltaTime / static_cast<float>(info.substeps);
+    }
+
+    for (auto i = 0; i < info.substeps; i++) {
+        auto substepDeltaTime = info.deltaTime;
+        substepDeltaTime *= SIMULATION_TIMESCALE;
+        integrate(substepDeltaTime);
+        collide();
+    }
+
+    return info;
+}
@@ -0,0 +1,53 @@
+#pragma once
+
+#include "simulator.hpp"
+#include "integrator.hpp"
+#include "config.h"
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <vector>
+
+namespace BallSimulator {
+    class World;
+
+    // A group of equally sized worlds stepped in lockstep. Ball i of every world shares one
+    // block, with one lane per world, so each loop over the lanes advances all of the worlds
+    // at once and compiles down to plain vector code. Collisions are brute force, in the same
+    // order as the serial DoSimpleCollisionDetection path.
+    class WorldBatch {
+    public:
+        static constexpr std::size_t Lanes = ENSEMBLE_BATCH_LANES;
+
+        struct alignas(Lanes * sizeof(float)) Block {
+            float x[Lanes], y[Lanes];
+            float vx[Lanes], vy[Lanes];
+            float radius[Lanes], inverseMass[Lanes];
+            std::int32_t flash[Lanes];
+        };
+
+    private:
+        std::size_t _worlds = 0;
+        Integrator _integrator = Integrator::SIMULATION_INTEGRATOR;
+        SubstepPolicy _substepPolicy;
+        std::array<float, Lanes> _gravity{};
+        std::array<float, Lanes> _width{}, _height{};
+        std::vector<Block> _blocks;
+
+        void integrate(float deltaTime);
+        void collide();
+
+    public:
+        // copies in up to Lanes worlds, which must agree on ball count and integrator; spare
+        // lanes repeat the last world so every lane always holds sensible numbers
+        bool load(std::span<const World> worlds);
+        void store(std::span<World> worlds) const;
+
+        // same policy as DoAdaptiveStep, with every lane taking the substep count of its fastest world
+        StepInfo step(float deltaTime);
+
+        inline std::size_t worlds() const { return _worlds; }
+        inline std::size_t balls() const { return _blocks.size(); }
+    };
+}
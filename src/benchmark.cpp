@@ -0,0 +1,317 @@
+#include "benchmark.hpp"
+
+#include <algorithm>
+#include <cstdlib>
+#include <iomanip>
+#include <numeric>
+#include <ostream>
+#include <unordered_map>
+
+using namespace BallSimulator;
+
+namespace {
+    // two-sided 95% quantiles of Student's t for 1 to 30 degrees of freedom
+    constexpr double StudentT95[] = {
+        12.706, 4.303, 3.182, 2.776, 2.571, 2.447, 2.365, 2.306, 2.262, 2.228,
+        2.201, 2.179, 2.160, 2.145, 2.131, 2.120, 2.110, 2.101, 2.093, 2.086,
+        2.080, 2.074, 2.069, 2.064, 2.060, 2.056, 2.052, 2.048, 2.045, 2.042
+    };
+
+    // times in the report are in nanoseconds, readable for a collide and a 1M ball step alike
+    inline double Nanoseconds(double seconds) {
+        return seconds * 1e9;
+    }
+
+    // benchmark names are ours, but keep the output valid JSON whatever they hold
+    void WriteString(std::ostream& out, const std::string& text) {
+        out << '"';
+        for (const auto c : text) {
+            if (c == '"' || c == '\\') {
+                out << '\\';
+            }
+            out << c;
+        }
+        out << '"';
+    }
+
+    inline void SkipSpace(std::string_view text, std::size_t& at) {
+        while (at < text.size() && (text[at] == ' ' || text[at] == '\t' || text[at] == '\n' || text[at] == '\r')) {
+            at++;
+        }
+    }
+
+    // moves at past "key": within object, or returns false if object has no such key
+    bool FindKey(std::string_view object, std::string_view key, std::size_t& at) {
+        std::string quoted;
+        quoted.reserve(key.size() + 2);
+        quoted += '"';
+        quoted += key;
+        quoted += '"';
+        const auto found = object.find(quoted);
+        if (found == std::string_view::npos) {
+            return false;
+        }
+        at = found + quoted.size();
+        SkipSpace(object, at);
+        if (at >= object.size() || object[at] != ':') {
+            return false;
+        }
+        at++;
+        SkipSpace(object, at);
+        return true;
+    }
+
+    bool ReadString(std::string_view object, std::string_view key, std::string& value) {
+        std::size_t at;
+        if (!FindKey(object, key, at) || at >= object.size() || object[at] != '"') {
+            return false;
+        }
+        value.clear();
+        for (at++; at < object.size() && object[at] != '"'; at++) {
+            if (object[at] == '\\' && at + 1 < object.size()) {
+                at++;
+            }
+            value += object[at];
+        }
+        return at < object.size();
+    }
+
+    bool ReadNumber(std::string_view object, std::string_view key, double& value) {
+        std::size_t at;
+        if (!FindKey(object, key, at)) {
+            return false;
+        }
+        // the object sits inside a longer, terminated text, so strtod stops before its end
+        char* end;
+        value = std::strtod(object.data() + at, &end);
+        return end != object.data() + at;
+    }
+
+    // times in comparisons print in whatever unit keeps them readable
+    void PrintTime(std::ostream& out, double seconds) {
+        if (seconds >= 1.0) {
+            out << std::setw(9) << seconds << " s ";
+        } else if (seconds >= 1e-3) {
+            out << std::setw(9) << seconds * 1e3 << " ms";
+        } else if (seconds >= 1e-6) {
+            out << std::setw(9) << seconds * 1e6 << " us";
+        } else {
+            out << std::setw(9) << seconds * 1e9 << " ns";
+        }
+    }
+}
+
+void BallSimulator::Summarise(BenchmarkResult& result) {
+    auto sorted = result.samples;
+    if (sorted.empty()) {
+        return;
+    }
+    std::sort(std::begin(sorted), std::end(sorted));
+
+    const auto count = sorted.size();
+    result.minimum = sorted.front();
+    result.median = count % 2 == 1 ? sorted[count / 2] : 0.5 * (sorted[count / 2 - 1] + sorted[count / 2]);
+    result.mean = std::accumulate(std::begin(sorted), std::end(sorted), 0.0) / static_cast<double>(count);
+
+    auto squares = 0.0;
+    for (const auto sample : sorted) {
+        squares += (sample - result.mean) * (sample - result.mean);
+    }
+    result.deviation = count > 1 ? std::sqrt(squares / static_cast<double>(count - 1)) : 0.0;
+
+    const auto degrees = count - 1;
+    const auto t = degrees == 0 ? 0.0 : degrees <= std::size(StudentT95) ? StudentT95[degrees - 1] : 1.96;
+    const auto margin = t * result.deviation / std::sqrt(static_cast<double>(count));
+    result.confidenceLow = result.mean - margin;
+    result.confidenceHigh = result.mean + margin;
+}
+
+double BallSimulator::Noise(const BenchmarkResult& result) {
+    return result.mean > 0.0 ? 0.5 * (result.confidenceHigh - result.confidenceLow) / result.mean : 0.0;
+}
+
+bool BallSimulator::ParseBaselines(std::string_view text, std::vector<BenchmarkBaseline>& baselines, std::string& error) {
+    baselines.clear();
+    std::size_t at;
+    if (!FindKey(text, "benchmarks", at) || at >= text.size() || text[at] != '[') {
+        error = "no benchmarks list";
+        return false;
+    }
+
+    // benchmark objects hold no nested objects, so each runs to the next closing brace
+    for (;;) {
+        SkipSpace(text, ++at);
+        if (at >= text.size()) {
+            error = "unterminated benchmarks list";
+            return false;
+        }
+        if (text[at] == ']') {
+            return true;
+        }
+        if (text[at] != '{') {
+            error = "expected a benchmark at offset " + std::to_string(at);
+            return false;
+        }
+        const auto end = text.find('}', at);
+        if (end == std::string_view::npos) {
+            error = "unterminated benchmark at offset " + std::to_string(at);
+            return false;
+        }
+
+        const auto object = text.substr(at, end + 1 - at);
+        BenchmarkBaseline baseline;
+        double median, mean, low, high;
+        if (!ReadString(object, "name", baseline.name) || !ReadNumber(object, "median_ns", median) ||
+            !ReadNumber(object, "mean_ns", mean) || !ReadNumber(object, "ci95_low_ns", low) ||
+            !ReadNumber(object, "ci95_high_ns", high)) {
+            error = "incomplete benchmark at offset " + std::to_string(at);
+            return false;
+        }
+        baseline.median = median * 1e-9;
+        baseline.noise = mean > 0.0 ? 0.5 * (high - low) / mean : 0.0;
+        baselines.push_back(std::move(baseline));
+
+        at = end + 1;
+        SkipSpace(text, at);
+        if (at >= text.size() || (text[at] != ',' && text[at] != ']')) {
+            error = "expected , or ] at offset " + std::to_string(at);
+            return false;
+        }
+        if (text[at] == ']') {
+            return true;
+        }
+    }
+}
+
+const char* BallSimulator::BenchmarkChangeName(BenchmarkChange change) {
+    switch (change) {
+        case BenchmarkChange::REGRESSED: return "regressed";
+        case BenchmarkChange::IMPROVED:  return "improved";
+        case BenchmarkChange::UNCHANGED: return "unchanged";
+        case BenchmarkChange::ADDED:     return "new";
+        case BenchmarkChange::NOT_RUN:   return "not run";
+    }
+    return "unknown";
+}
+
+std::vector<BenchmarkComparison> BallSimulator::CompareBaselines(std::span<const BenchmarkBaseline> baselines,
+        std::span<const BenchmarkResult> results, double tolerance) {
+    std::unordered_map<std::string, const BenchmarkBaseline*> byName;
+    for (const auto& baseline : baselines) {
+        byName.emplace(baseline.name, &baseline);
+    }
+
+    std::vector<BenchmarkComparison> comparisons;
+    std::unordered_map<std::string, bool> compared;
+    for (const auto& result : results) {
+        BenchmarkComparison comparison;
+        comparison.name = result.name;
+        comparison.current = result.median;
+        const auto found = byName.find(result.name);
+        if (found == std::end(byName)) {
+            comparison.change = BenchmarkChange::ADDED;
+        } else {
+            const auto& baseline = *found->second;
+            compared[baseline.name] = true;
+            comparison.baseline = baseline.median;
+            comparison.ratio = baseline.median > 0.0 ? result.median / baseline.median : 1.0;
+            comparison.threshold = std::max(tolerance, baseline.noise + Noise(result));
+            comparison.change = comparison.ratio > 1.0 + comparison.threshold ? BenchmarkChange::REGRESSED :
+                comparison.ratio < 1.0 - comparison.threshold ? BenchmarkChange::IMPROVED : BenchmarkChange::UNCHANGED;
+        }
+        comparisons.push_back(std::move(comparison));
+    }
+
+    // a filtered run leaves some of the baseline out, which says nothing about its speed
+    for (const auto& baseline : baselines) {
+        if (!compared.contains(baseline.name)) {
+            BenchmarkComparison comparison;
+            comparison.name = baseline.name;
+            comparison.change = BenchmarkChange::NOT_RUN;
+            comparison.baseline = baseline.median;
+            comparisons.push_back(std::move(comparison));
+        }
+    }
+    return comparisons;
+}
+
+void BallSimulator::PrintComparison(std::ostream& out, std::span<const BenchmarkComparison> comparisons) {
+    const auto flags = out.flags();
+    std::size_t counts[5] = {};
+    out << std::fixed << std::setprecision(3);
+    for (const auto& comparison : comparisons) {
+        counts[static_cast<int>(comparison.change)]++;
+        // a filtered run leaves out most of the baseline, so those are only counted
+        if (comparison.change == BenchmarkChange::UNCHANGED || comparison.change == BenchmarkChange::NOT_RUN) {
+            continue;
+        }
+
+        out << std::left << std::setw(10) << BenchmarkChangeName(comparison.change) << std::setw(48) << comparison.name
+            << std::right;
+        if (comparison.change == BenchmarkChange::REGRESSED || comparison.change == BenchmarkChange::IMPROVED) {
+            PrintTime(out, comparison.baseline);
+            out << " -> ";
+            PrintTime(out, comparison.current);
+            // past ten times slower a percentage gets too wide to line up, so it becomes a factor
+            out << "  " << std::setprecision(1);
+            if (comparison.ratio < 10.0) {
+                out << std::showpos << std::setw(9) << 100.0 * (comparison.ratio - 1.0) << std::noshowpos << "%";
+            } else {
+                out << std::setw(9) << comparison.ratio << "x";
+            }
+            out << " (threshold " << 100.0 * comparison.threshold << "%)" << std::setprecision(3);
+        } else {
+            PrintTime(out, comparison.current);
+        }
+        out << std::endl;
+    }
+    out << counts[static_cast<int>(BenchmarkChange::REGRESSED)] << " regressed, "
+        << counts[static_cast<int>(BenchmarkChange::IMPROVED)] << " improved, "
+        << counts[static_cast<int>(BenchmarkChange::UNCHANGED)] << " within noise, "
+        << counts[static_cast<int>(BenchmarkChange::ADDED)] << " new, "
+        << counts[static_cast<int>(BenchmarkChange::NOT_RUN)] << " not run" << std::endl;
+    out.flags(flags);
+}
+
+void BenchmarkRunner::print(std::ostream& out, const BenchmarkResult& result) const {
+    const auto flags = out.flags();
+    const auto margin = 0.5 * (result.confidenceHigh - result.confidenceLow);
+    out << std::left << std::setw(48) << result.name << std::right << std::fixed << std::setprecision(1)
+        << std::setw(16) << Nanoseconds(result.median) << " ns  +/- " << std::setw(5)
+        << (result.mean > 0.0 ? 100.0 * margin / result.mean : 0.0) << "%";
+    if (result.items > 0 && result.median > 0.0) {
+        out << std::setprecision(3) << std::scientific << std::setw(12)
+            << static_cast<double>(result.items) / result.median << " items/s";
+    }
+    out << std::endl;
+    out.flags(flags);
+}
+
+void BenchmarkRunner::write_json(std::ostream& out) const {
+    const auto flags = out.flags();
+    out << std::setprecision(9);
+    out << "{\n";
+    out << "  \"warmup\": " << _options.warmup << ",\n";
+    out << "  \"repetitions\": " << _options.repetitions << ",\n";
+    out << "  \"benchmarks\": [";
+    for (std::size_t i = 0; i < _results.size(); i++) {
+        const auto& result = _results[i];
+        out << (i > 0 ? ",\n" : "\n") << "    { \"name\": ";
+        WriteString(out, result.name);
+        out << ", \"items\": " << result.items
+            << ", \"iterations\": " << result.iterations
+            << ", \"median_ns\": " << Nanoseconds(result.median)
+            << ", \"mean_ns\": " << Nanoseconds(result.mean)
+            << ", \"stddev_ns\": " << Nanoseconds(result.deviation)
+            << ", \"min_ns\": " << Nanoseconds(result.minimum)
+            << ", \"ci95_low_ns\": " << Nanoseconds(result.confidenceLow)
+            << ", \"ci95_high_ns\": " << Nanoseconds(result.confidenceHigh)
+            << ", \"samples_ns\": [";
+        for (std::size_t j = 0; j < result.samples.size(); j++) {
+            out << (j > 0 ? ", " : "") << Nanoseconds(result.samples[j]);
+        }
+        out << "] }";
+    }
+    out << "\n  ]\n}\n";
+    out.flags(flags);
+}
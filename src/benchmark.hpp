@@ -0,0 +1,138 @@
+#pragma once
+
+#include "config.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <iosfwd>
+#include <span>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+namespace BallSimulator {
+    struct BenchmarkOptions {
+        int warmup = BENCHMARK_WARMUP;
+        int repetitions = BENCHMARK_REPETITIONS;
+        double minSampleSeconds = BENCHMARK_MIN_SAMPLE_SECONDS;
+    };
+
+    // times are per iteration, in seconds
+    struct BenchmarkResult {
+        std::string name;                   // benchmark/parameter:value/..., unique within a run
+        std::uint64_t items = 0;            // units of work in one iteration, for throughput
+        std::uint64_t iterations = 0;       // in every sample
+        std::vector<double> samples;
+        double median = 0.0;
+        double mean = 0.0;
+        double deviation = 0.0;
+        double minimum = 0.0;
+        double confidenceLow = 0.0;         // 95% confidence interval of the mean
+        double confidenceHigh = 0.0;
+    };
+
+    // fills in the statistics of result from its samples
+    void Summarise(BenchmarkResult& result);
+
+    // the relative half width of the 95% confidence interval of result: how far apart two runs
+    // of it can land by chance alone
+    double Noise(const BenchmarkResult& result);
+
+    // one benchmark of a stored run, in the JSON write_json produces; times in seconds
+    struct BenchmarkBaseline {
+        std::string name;
+        double median = 0.0;
+        double noise = 0.0;
+    };
+
+    // reads every benchmark of a stored run; false with error set if text isn't one
+    bool ParseBaselines(std::string_view text, std::vector<BenchmarkBaseline>& baselines, std::string& error);
+
+    enum class BenchmarkChange {
+        REGRESSED, IMPROVED, UNCHANGED, ADDED, NOT_RUN
+    };
+
+    const char* BenchmarkChangeName(BenchmarkChange change);
+
+    struct BenchmarkComparison {
+        std::string name;
+        BenchmarkChange change = BenchmarkChange::UNCHANGED;
+        double baseline = 0.0;      // median seconds, zero if ADDED
+        double current = 0.0;       // median seconds, zero if NOT_RUN
+        double ratio = 1.0;         // current / baseline
+        double threshold = 0.0;     // relative change that counts, tolerance or the noise of both runs
+    };
+
+    // a median only moves when it shifts by more than tolerance and by more than the noise of
+    // the baseline and of this run together, so a jittery benchmark needs a bigger shift to fail
+    std::vector<BenchmarkComparison> CompareBaselines(std::span<const BenchmarkBaseline> baselines,
+        std::span<const BenchmarkResult> results, double tolerance);
+    // every benchmark that moved or is new, then how many of each kind there were
+    void PrintComparison(std::ostream& out, std::span<const BenchmarkComparison> comparisons);
+
+    // stops the compiler from dropping work whose result is never used
+    template <typename T>
+    inline void KeepResult(const T& value) {
+#if defined(__GNUC__) || defined(__clang__)
+        asm volatile("" : : "r"(&value) : "memory");
+#else
+        static const volatile void* sink;
+        sink = &value;
+#endif
+    }
+
+    // Times benchmarks and collects their results. Every benchmark first runs untimed for the
+    // warm-up, which also measures how many iterations a sample needs to last minSampleSeconds
+    // so that even nanosecond operations get clock-resolution-proof samples; then it is timed
+    // for repetitions samples.
+    class BenchmarkRunner {
+        BenchmarkOptions _options;
+        std::vector<BenchmarkResult> _results;
+
+    public:
+        explicit BenchmarkRunner(const BenchmarkOptions& options = {}) : _options(options) {}
+
+        inline const BenchmarkOptions& options() const { return _options; }
+        inline const std::vector<BenchmarkResult>& results() const { return _results; }
+
+        template <typename F>
+        const BenchmarkResult& run(std::string name, std::uint64_t items, F&& body);
+
+        // one line per benchmark: median, confidence interval and throughput
+        void print(std::ostream& out, const BenchmarkResult& result) const;
+        void write_json(std::ostream& out) const;
+    };
+
+    template <typename F>
+    const BenchmarkResult& BenchmarkRunner::run(std::string name, std::uint64_t items, F&& body) {
+        typedef std::chrono::steady_clock clock;
+
+        BenchmarkResult result;
+        result.name = std::move(name);
+        result.items = items;
+
+        auto once = 0.0;
+        for (auto i = 0; i < std::max(_options.warmup, 1); i++) {
+            const auto start = clock::now();
+            body();
+            once = std::chrono::duration<double>(clock::now() - start).count();
+        }
+        result.iterations = once > 0.0 && once < _options.minSampleSeconds ?
+            static_cast<std::uint64_t>(std::ceil(_options.minSampleSeconds / once)) : 1;
+
+        for (auto i = 0; i < std::max(_options.repetitions, 1); i++) {
+            const auto start = clock::now();
+            for (std::uint64_t j = 0; j < result.iterations; j++) {
+                body();
+            }
+            const auto elapsed = std::chrono::duration<double>(clock::now() - start).count();
+            result.samples.push_back(elapsed / static_cast<double>(result.iterations));
+        }
+
+        Summarise(result);
+        _results.push_back(std::move(result));
+        return _results.back();
+    }
+}
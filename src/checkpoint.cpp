@@ -0,0 +1,210 @@
+#include "checkpoint.hpp"
+#include "mappedfile.hpp"
+#include "world.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstdio>
+#include <cstring>
+#include <type_traits>
+
+using namespace BallSimulator;
+
+namespace {
+    constexpr char CheckpointMagic[8] = { 'B', 'S', 'C', 'H', 'K', 'P', 'T', '\0' };
+    constexpr std::uint32_t CheckpointVersion = 1;
+
+    // the balls start right after the header; the spare bytes leave room for new fields
+    struct CheckpointHeader {
+        char magic[8];
+        std::uint32_t version;
+        std::uint32_t ballBytes;
+        std::uint64_t balls;
+        std::uint64_t step;
+        std::uint64_t seed;
+        std::uint32_t generation;
+        std::uint32_t integrator;
+        float bounds[4];
+        float gravity;
+        float maxDisplacement;
+        std::int32_t maxSubsteps;
+        std::uint32_t deterministic;
+        std::uint64_t hash;
+        std::uint8_t reserved[40];
+    };
+
+    static_assert(sizeof(CheckpointHeader) == 128, "checkpoint header layout changed");
+    static_assert(std::is_trivially_copyable_v<Ball>, "balls are checkpointed as raw bytes");
+
+    inline double Since(std::chrono::steady_clock::time_point start) {
+        return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    }
+}
+
+std::uint64_t BallSimulator::HashBalls(std::span<const Ball> balls) {
+    // four independent FNV-style lanes over 64 bit words, so the multiplies don't serialise
+    constexpr std::uint64_t Prime = 0x100000001B3ull;
+    std::uint64_t lanes[4] = { 0xCBF29CE484222325ull, 0x84222325CBF29CE4ull, 0x9E3779B97F4A7C15ull, 0xBB67AE8584CAA73Bull };
+
+    const auto bytes = std::as_bytes(balls);
+    const auto words = bytes.size() / sizeof(std::uint64_t);
+    std::size_t i = 0;
+    for (; i + 4 <= words; i += 4) {
+        for (std::size_t lane = 0; lane < 4; lane++) {
+            std::uint64_t word;
+            std::memcpy(&word, bytes.data() + (i + lane) * sizeof(word), sizeof(word));
+            lanes[lane] = (lanes[lane] ^ word) * Prime;
+        }
+    }
+    for (auto offset = i * sizeof(std::uint64_t); offset < bytes.size(); offset++) {
+        lanes[0] = (lanes[0] ^ static_cast<std::uint64_t>(bytes[offset])) * Prime;
+    }
+
+    auto hash = static_cast<std::uint64_t>(bytes.size());
+    for (auto lane : lanes) {
+        hash = (hash ^ lane) * Prime;
+        hash ^= hash >> 29;
+    }
+    return hash;
+}
+
+Checkpointer::Checkpointer(std::string path, OutputPolicy policy) :
+    _path(std::move(path)), _output(1, policy, [this](Snapshot& snapshot) { write(snapshot); }) {}
+
+Checkpointer::~Checkpointer() {
+    _output.stop();
+}
+
+bool Checkpointer::capture(const World& world, std::uint64_t step) {
+    const auto start = std::chrono::steady_clock::now();
+    auto* snapshot = _output.acquire();
+    if (snapshot == nullptr) {
+        return false;
+    }
+
+    const auto& entities = world.entities();
+    snapshot->balls.assign(std::begin(entities), std::end(entities));
+
+    CheckpointHeader header{};
+    std::memcpy(header.magic, CheckpointMagic, sizeof(CheckpointMagic));
+    header.version = CheckpointVersion;
+    header.ballBytes = sizeof(Ball);
+    header.balls = entities.size();
+    header.step = step;
+    header.seed = world.seed();
+    header.generation = world.generation();
+    header.integrator = static_cast<std::uint32_t>(world.integrator());
+    header.bounds[0] = world.bounds().x;
+    header.bounds[1] = world.bounds().y;
+    header.bounds[2] = world.bounds().w;
+    header.bounds[3] = world.bounds().h;
+    header.gravity = world.gravity();
+    header.maxDisplacement = world.substep_policy().maxDisplacement;
+    header.maxSubsteps = world.substep_policy().maxSubsteps;
+    header.deterministic = world.deterministic();
+    snapshot->header.resize(sizeof(header));
+    std::memcpy(snapshot->header.data(), &header, sizeof(header));
+
+    _output.publish();
+
+    const auto pause = Since(start);
+    _stats.checkpoints++;
+    _stats.pauseSeconds += pause;
+    _stats.maxPauseSeconds = std::max(_stats.maxPauseSeconds, pause);
+    return true;
+}
+
+void Checkpointer::write(Snapshot& snapshot) {
+    const auto start = std::chrono::steady_clock::now();
+
+    // the hash is filled in here rather than in capture() to keep it off the stepping thread
+    const auto hash = HashBalls(snapshot.balls);
+    std::memcpy(snapshot.header.data() + offsetof(CheckpointHeader, hash), &hash, sizeof(hash));
+
+    const auto temporary = _path + ".tmp";
+    auto* file = std::fopen(temporary.c_str(), "wb");
+    auto ok = file != nullptr;
+    if (ok) {
+        ok = std::fwrite(snapshot.header.data(), 1, snapshot.header.size(), file) == snapshot.header.size() &&
+            std::fwrite(snapshot.balls.data(), sizeof(Ball), snapshot.balls.size(), file) == snapshot.balls.size();
+        ok = std::fclose(file) == 0 && ok;
+    }
+    ok = ok && std::rename(temporary.c_str(), _path.c_str()) == 0;
+    if (!ok) {
+        std::remove(temporary.c_str());
+    }
+
+    _ok = _ok && ok;
+    _bytes += snapshot.header.size() + snapshot.balls.size() * sizeof(Ball);
+    _writeSeconds += Since(start);
+}
+
+bool Checkpointer::wait() {
+    _output.drain();
+    return _ok;
+}
+
+const CheckpointStats& Checkpointer::stats() {
+    // the writer's own figures are only safe to read once it has nothing left to do
+    if (_output.depth() == 0) {
+        _stats.bytes = _bytes;
+        _stats.writeSeconds = _writeSeconds;
+    }
+    _stats.output = _output.stats();
+    return _stats;
+}
+
+bool BallSimulator::RestoreCheckpoint(const std::string& path, World& world, std::uint64_t& step, std::string& error) {
+    const auto file = MappedFile::open(path);
+    if (file == nullptr) {
+        error = "can't open " + path;
+        return false;
+    }
+
+    CheckpointHeader header;
+    const auto bytes = file->bytes();
+    if (bytes.size() < sizeof(header)) {
+        error = "truncated header";
+        return false;
+    }
+    std::memcpy(&header, bytes.data(), sizeof(header));
+    if (std::memcmp(header.magic, CheckpointMagic, sizeof(CheckpointMagic)) != 0) {
+        error = "not a checkpoint";
+        return false;
+    }
+    if (header.version != CheckpointVersion || header.ballBytes != sizeof(Ball)) {
+        error = "checkpoint version " + std::to_string(header.version) + " with " + std::to_string(header.ballBytes) +
+            " byte balls can't be read by this build";
+        return false;
+    }
+    if (header.balls != (bytes.size() - sizeof(header)) / sizeof(Ball) ||
+        (bytes.size() - sizeof(header)) % sizeof(Ball) != 0) {
+        error = "ball count doesn't match the file size";
+        return false;
+    }
+    if (header.integrator > static_cast<std::uint32_t>(Integrator::POSITION_VERLET)) {
+        error = "unknown integrator";
+        return false;
+    }
+
+    const std::span balls(reinterpret_cast<const Ball*>(bytes.data() + sizeof(header)), static_cast<std::size_t>(header.balls));
+    if (HashBalls(balls) != header.hash) {
+        error = "ball data is corrupt";
+        return false;
+    }
+
+    world.resize({ header.bounds[0], header.bounds[1], header.bounds[2], header.bounds[3] });
+    world.set_gravity(header.gravity);
+    world.set_integrator(static_cast<Integrator>(header.integrator));
+    world.set_substep_policy({ header.maxDisplacement, header.maxSubsteps });
+    world.set_deterministic(header.deterministic != 0);
+    world.seed(header.seed, header.generation);
+
+    auto& entities = world.entities();
+    entities.resize(balls.size(), Ball(0.0f, 0.0f));
+    std::memcpy(static_cast<void*>(entities.data()), balls.data(), balls.size_bytes());
+
+    step = header.step;
+    return true;
+}
@@ -0,0 +1,71 @@
+#pragma once
+
+#include "ball.hpp"
+#include "outputstage.hpp"
+#include <cstdint>
+#include <memory>
+#include <span>
+#include <string>
+#include <vector>
+
+namespace BallSimulator {
+    class World;
+
+    struct CheckpointStats {
+        std::uint64_t checkpoints = 0;
+        std::uint64_t bytes = 0;
+        double pauseSeconds = 0.0;      // time the stepping loop spent in capture()
+        double maxPauseSeconds = 0.0;
+        double writeSeconds = 0.0;      // time the writer thread spent writing
+        OutputStats output;
+    };
+
+    // cheap enough to validate a restore with, and handy for checking that two runs ended
+    // up in exactly the same state
+    std::uint64_t HashBalls(std::span<const Ball> balls);
+
+    // Writes checkpoints of a world: a fixed header holding the world parameters, step counter
+    // and random state, followed by the raw ball array, so restoring is a map, a check and a
+    // copy. Each checkpoint goes to a temporary file that then replaces the previous one, so a
+    // crash mid-write still leaves the last good checkpoint behind.
+    class Checkpointer {
+        struct Snapshot {
+            std::vector<std::byte> header;
+            std::vector<Ball> balls;
+        };
+
+        std::string _path;
+        CheckpointStats _stats;
+
+        // written by the writer thread, only read once it has drained
+        bool _ok = true;
+        std::uint64_t _bytes = 0;
+        double _writeSeconds = 0.0;
+
+        // one slot: a checkpoint is the size of the whole world, so never hold two copies
+        OutputStage<Snapshot> _output;
+
+        void write(Snapshot& snapshot);
+
+    public:
+        explicit Checkpointer(std::string path, OutputPolicy policy = OutputPolicy::BLOCK);
+        ~Checkpointer();
+
+        Checkpointer(const Checkpointer&) = delete;
+        Checkpointer& operator =(const Checkpointer&) = delete;
+
+        // copies the state of world after step steps for the writer thread. under BLOCK this
+        // waits for the previous write to finish, so the pause is that wait plus a copy of the
+        // ball array; under DROP the checkpoint is skipped instead and false returned
+        bool capture(const World& world, std::uint64_t step);
+
+        // waits for the write in flight; false if any write so far has failed
+        bool wait();
+
+        const CheckpointStats& stats();
+    };
+
+    // replaces the balls, parameters and random state of world with the checkpoint's and
+    // sets step to the step it was taken after. the threading setup is left alone
+    bool RestoreCheckpoint(const std::string& path, World& world, std::uint64_t& step, std::string& error);
+}
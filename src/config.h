@@ -10,5 +10,29 @@
 #define SIMULATION_TIMESCALE 10.0 * 2.0
 //#define SIMULATION_LOSSES
 #define SIMULATION_GRAVITY 0.0
+#define SIMULATION_SEED 1
+#define SIMULATION_INTEGRATOR SYMPLECTIC_EULER
+#define SUBSTEP_MAX_DISPLACEMENT 0.5f
+#define SUBSTEP_MAX_COUNT 16
+#define PHYSICS_STEP_RATE 120.0
+#define PHYSICS_MAX_STEPS_PER_FRAME 8
+#define PARALLEL_GRAIN_SIZE 1024
+#define DOMAIN_REBALANCE_DAMPING 0.5f
+#define WORK_STEALING_MIN_LEAF_TASK 16
+#define WORK_STEALING_SPIN_ROUNDS 64
+#define DETERMINISTIC_REDUCTION_BLOCK 4096
+#define ENSEMBLE_BATCH_LANES 8
+#define SCENARIO_MAX_BALLS (1 << 26)
+#define SHARED_MEMORY_RING_BYTES (4 << 20)
+#define TRAJECTORY_CHUNK_FRAMES 32
+#define TRAJECTORY_BALL_BLOCK 1024
+#define TRAJECTORY_CHUNK_BYTES (64 << 20)
+#define PLAYBACK_MAX_SPEED 64.0
+#define BENCHMARK_WARMUP 2
+#define BENCHMARK_REPETITIONS 10
+#define BENCHMARK_MIN_SAMPLE_SECONDS 0.01
+#define BENCHMARK_REGRESSION_TOLERANCE 0.10
+#define ALLOCATION_WARMUP_STEPS 100
+#define ALLOCATION_MEASURED_STEPS 100
 #define USE_QUADTREES
 #define SHOW_QUADTREE_HEATMAP
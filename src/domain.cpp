@@ -0,0 +1,233 @@
+#include "domain.hpp"
+#include "world.hpp"
+#include "threadpool.hpp"
+#include "config.h"
+
+#include <algorithm>
+#include <chrono>
+#include <limits>
+
+using namespace BallSimulator;
+
+namespace {
+    constexpr std::uint16_t NoOwner = std::numeric_limits<std::uint16_t>::max();
+
+    inline std::size_t ChunkBegin(std::size_t count, unsigned chunk, unsigned chunks) {
+        return count * chunk / chunks;
+    }
+}
+
+void DomainDecomposition::partition(const Rectangle<float>& bounds, unsigned tiles) {
+    tiles = std::clamp(tiles, 1u, static_cast<unsigned>(NoOwner));
+    _bounds = bounds;
+    _tiles.resize(tiles);
+
+    const auto width = bounds.w / static_cast<float>(tiles);
+    for (unsigned i = 0; i < tiles; i++) {
+        _tiles[i].x1 = bounds.x + width * static_cast<float>(i);
+        _tiles[i].x2 = i + 1 == tiles ? bounds.x + bounds.w : bounds.x + width * static_cast<float>(i + 1);
+        _tiles[i].seconds = 0.0;
+    }
+
+    std::fill(std::begin(_owner), std::end(_owner), NoOwner);
+}
+
+void DomainDecomposition::assign_owners(std::span<const Ball> balls, ThreadPool& pool, float& maxRadius) {
+    const auto threads = pool.size();
+    const auto tiles = static_cast<unsigned>(_tiles.size());
+    const auto count = balls.size();
+
+    _owner.resize(count, NoOwner);
+    _order.resize(count);
+    _counts.assign(static_cast<std::size_t>(threads) * tiles, 0);
+    _radii.assign(threads, 0.0f);
+    _reassigned.assign(threads, 0);
+
+    // balls left of the first strip or right of the last still belong to the end strips
+    const auto tile_of = [&](float x) {
+        auto it = std::partition_point(std::begin(_tiles), std::end(_tiles) - 1,
+            [x](const DomainTile& tile) { return x >= tile.x2; });
+        return static_cast<unsigned>(it - std::begin(_tiles));
+    };
+
+    // counting sort into _order, using fixed per-thread ranges so each tile's balls stay in index order
+    pool.run([&](unsigned thread) {
+        auto* counts = &_counts[static_cast<std::size_t>(thread) * tiles];
+        for (auto i = ChunkBegin(count, thread, threads); i < ChunkBegin(count, thread + 1, threads); i++) {
+            const auto tile = static_cast<std::uint16_t>(tile_of(balls[i].get_position().x));
+            if (_owner[i] != tile && _owner[i] != NoOwner) {
+                _reassigned[thread]++;
+            }
+            _owner[i] = tile;
+            counts[tile]++;
+            _radii[thread] = std::max(_radii[thread], balls[i].radius());
+        }
+    });
+
+    std::size_t offset = 0;
+    for (unsigned tile = 0; tile < tiles; tile++) {
+        _tiles[tile].first = offset;
+        for (unsigned thread = 0; thread < threads; thread++) {
+            auto& slot = _counts[static_cast<std::size_t>(thread) * tiles + tile];
+            const auto n = slot;
+            slot = offset;
+            offset += n;
+        }
+        _tiles[tile].count = offset - _tiles[tile].first;
+    }
+
+    pool.run([&](unsigned thread) {
+        auto* offsets = &_counts[static_cast<std::size_t>(thread) * tiles];
+        for (auto i = ChunkBegin(count, thread, threads); i < ChunkBegin(count, thread + 1, threads); i++) {
+            _order[offsets[_owner[i]]++] = static_cast<std::uint32_t>(i);
+        }
+    });
+
+    maxRadius = *std::max_element(std::begin(_radii), std::end(_radii));
+    _stats.reassigned = 0;
+    for (auto n : _reassigned) {
+        _stats.reassigned += n;
+    }
+}
+
+void DomainDecomposition::exchange_halo(DomainTile& tile, unsigned index, std::span<const Ball> balls, float reach) {
+    // a pair across an edge belongs to the strip left of it, so only the right side is copied
+    const auto high = tile.x2 + reach;
+
+    tile.halo.clear();
+    tile.haloIndices.clear();
+    for (auto k = index + 1; k < _tiles.size(); k++) {
+        const auto& neighbour = _tiles[k];
+        for (auto i = neighbour.first; i < neighbour.first + neighbour.count; i++) {
+            const auto& ball = balls[_order[i]];
+            if (ball.get_position().x < high) {
+                tile.halo.push_back(ball);
+                tile.haloIndices.push_back(_order[i]);
+            }
+        }
+        if (neighbour.x2 >= high) {
+            break;
+        }
+    }
+}
+
+void DomainDecomposition::rebalance() {
+    const auto tiles = _tiles.size();
+    double total = 0.0, slowest = 0.0;
+    for (const auto& tile : _tiles) {
+        total += tile.seconds;
+        slowest = std::max(slowest, tile.seconds);
+    }
+    if (tiles < 2 || total <= 0.0) {
+        return;
+    }
+    _stats.imbalance = slowest / (total / static_cast<double>(tiles));
+
+    // treat each strip's cost as spread evenly over its width and move the inner edges
+    // towards the equal-cost quantiles, damped so timing noise doesn't make them oscillate
+    const auto target = total / static_cast<double>(tiles);
+    auto& edges = _edges;
+    edges.resize(tiles + 1);
+    for (std::size_t i = 0; i < tiles; i++) {
+        edges[i] = _tiles[i].x1;
+    }
+    edges[tiles] = _tiles.back().x2;
+
+    double accumulated = 0.0;
+    std::size_t edge = 1;
+    for (std::size_t i = 0; i < tiles && edge < tiles; i++) {
+        const auto cost = _tiles[i].seconds;
+        while (cost > 0.0 && edge < tiles && accumulated + cost >= target * static_cast<double>(edge)) {
+            const auto fraction = (target * static_cast<double>(edge) - accumulated) / cost;
+            const auto ideal = _tiles[i].x1 + static_cast<float>(fraction) * (_tiles[i].x2 - _tiles[i].x1);
+            edges[edge] += DOMAIN_REBALANCE_DAMPING * (ideal - edges[edge]);
+            edge++;
+        }
+        accumulated += cost;
+    }
+
+    for (std::size_t i = 1; i < tiles; i++) {
+        edges[i] = std::clamp(edges[i], edges[i - 1], edges[tiles]);
+        _tiles[i - 1].x2 = _tiles[i].x1 = edges[i];
+    }
+}
+
+void DomainDecomposition::step(World& world, ThreadPool& pool) {
+    auto& balls = world.entities();
+    const auto& bounds = world.bounds();
+    if (_tiles.size() != pool.size() || bounds.x != _bounds.x || bounds.y != _bounds.y ||
+        bounds.w != _bounds.w || bounds.h != _bounds.h) {
+        partition(bounds, pool.size());
+    }
+
+    float maxRadius = 0.0f;
+    assign_owners(balls, pool, maxRadius);
+    const auto reach = 2.0f * maxRadius;
+
+    // every strip takes its halo copies before any strip starts moving its own balls
+    pool.run([&](unsigned thread) {
+        const auto start = std::chrono::steady_clock::now();
+        exchange_halo(_tiles[thread], thread, balls, reach);
+        _tiles[thread].seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    });
+
+    pool.run([&](unsigned thread) {
+        const auto start = std::chrono::steady_clock::now();
+        auto& tile = _tiles[thread];
+        const std::span<const std::uint32_t> owned(_order.data() + tile.first, tile.count);
+
+        tile.tree.reset({ tile.x1 - reach, bounds.y, tile.x2 - tile.x1 + 2.0f * reach, bounds.h });
+        for (auto i : owned) {
+            tile.tree.insert(std::ref(balls[i]));
+        }
+
+        // the tree only holds owned balls, so every pair it gives is ours to resolve
+        for (auto i : owned) {
+            auto& ballA = balls[i];
+            tile.tree.retrieve(tile.candidates, std::ref(ballA));
+            for (auto& ballB : tile.candidates) {
+                if (&ballB.get() != &ballA) {
+                    ballA.collide(ballB);
+                }
+            }
+            tile.candidates.clear();
+        }
+
+        // pairs with a ball of a strip to the right are only noted here, as that strip is busy
+        // moving it; they are resolved once every strip is done
+        tile.crossings.clear();
+        for (std::size_t k = 0; k < tile.halo.size(); k++) {
+            tile.tree.retrieve(tile.candidates, std::ref(tile.halo[k]));
+            for (auto& ballA : tile.candidates) {
+                const auto a = static_cast<std::uint32_t>(&ballA.get() - balls.data());
+                tile.crossings.push_back({ a, tile.haloIndices[k] });
+            }
+            tile.candidates.clear();
+        }
+
+        tile.seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    });
+
+    // each pair across an edge was noted by one strip only, and gets the full response once,
+    // exactly as the shared tree resolves its contacts
+    for (const auto& tile : _tiles) {
+        for (const auto& [a, b] : tile.crossings) {
+            balls[a].collide(balls[b]);
+        }
+    }
+
+    pool.run([&](unsigned thread) {
+        const auto start = std::chrono::steady_clock::now();
+        auto& tile = _tiles[thread];
+        for (auto i = tile.first; i < tile.first + tile.count; i++) {
+            balls[_order[i]].apply_world_boundary(world);
+        }
+        tile.seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    });
+
+    _stats.halo = 0;
+    for (const auto& tile : _tiles) {
+        _stats.halo += tile.halo.size();
+    }
+    rebalance();
+}
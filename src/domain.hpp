@@ -0,0 +1,66 @@
+#pragma once
+
+#include "simulator.hpp"
+#include "ball.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <utility>
+#include <vector>
+
+namespace BallSimulator {
+    class ThreadPool;
+
+    // One vertical strip of the world. The worker that runs it owns every ball whose centre
+    // lies inside [x1, x2), meaning it alone writes them while strips run, and builds its
+    // broadphase over those. Read-only copies of the balls in strips to its right that are
+    // close enough to touch its own (the halo) are looked up in that broadphase, and the pairs
+    // found are resolved on one thread after every strip has finished.
+    //
+    // Strips split the broadphase, not the storage: balls stay where they are in
+    // World::entities() and a strip reaches its own through the indices in order(). A ball
+    // crossing an edge just changes owner. Keeping each strip's balls apart, and handing them
+    // over as they cross, is what ProcessDomain does between processes.
+    struct DomainTile {
+        float x1 = 0.0f, x2 = 0.0f;
+        std::size_t first = 0, count = 0;   // owned range within DomainDecomposition::order()
+        std::vector<Ball> halo;
+        std::vector<std::uint32_t> haloIndices;     // where each halo copy came from
+        std::vector<std::pair<std::uint32_t, std::uint32_t>> crossings;  // owned ball, halo ball
+        CollisionQuadtree tree;
+        std::vector<CollisionQuadtree::RefT> candidates;
+        double seconds = 0.0;   // wall time of the last step, drives rebalancing
+    };
+
+    struct DomainStats {
+        std::size_t reassigned = 0; // balls whose owning strip changed this step
+        std::size_t halo = 0;       // halo copies exchanged this step
+        double imbalance = 1.0;     // slowest tile time / mean tile time
+    };
+
+    class DomainDecomposition {
+        std::vector<DomainTile> _tiles;
+        std::vector<std::uint32_t> _order;   // ball indices grouped by owning tile
+        std::vector<std::uint16_t> _owner;
+        std::vector<std::size_t> _counts;    // per thread, per tile histogram used to build _order
+        std::vector<float> _radii;
+        std::vector<std::size_t> _reassigned;
+        std::vector<float> _edges;           // strip edges while rebalancing
+        Rectangle<float> _bounds = Rectangle<float>::zero();
+        DomainStats _stats;
+
+        void assign_owners(std::span<const Ball> balls, ThreadPool& pool, float& maxRadius);
+        void exchange_halo(DomainTile& tile, unsigned index, std::span<const Ball> balls, float reach);
+        void rebalance();
+
+    public:
+        void partition(const Rectangle<float>& bounds, unsigned tiles);
+
+        // resolves collisions and world boundaries for every ball, one tile per pool thread
+        void step(World& world, ThreadPool& pool);
+
+        inline std::span<const DomainTile> tiles() const { return _tiles; }
+        inline std::span<const std::uint32_t> order() const { return _order; }
+        inline const DomainStats& stats() const { return _stats; }
+    };
+}
@@ -0,0 +1,161 @@
+#include "integrator.hpp"
+#include "world.hpp"
+#include "ball.hpp"
+#include "config.h"
+
+#include <algorithm>
+#include <cmath>
+#include <span>
+#include <vector>
+
+using namespace BallSimulator;
+
+namespace {
+    // each kernel is a tight loop over a contiguous run of balls so the integrator is picked
+    // once per chunk rather than once per ball
+
+    void ExplicitEulerKernel(std::span<Ball> balls, const vec2f& accel, float deltaTime) {
+        for (auto& ball : balls) {
+            const auto velocity = ball.get_velocity();
+            ball.set_position(ball.get_position() + velocity * deltaTime);
+            ball.set_velocity(velocity + accel * deltaTime);
+        }
+    }
+
+    void SymplecticEulerKernel(std::span<Ball> balls, const vec2f& accel, float deltaTime) {
+        for (auto& ball : balls) {
+            const auto velocity = ball.get_velocity() + accel * deltaTime;
+            ball.set_velocity(velocity);
+            ball.set_position(ball.get_position() + velocity * deltaTime);
+        }
+    }
+
+    void VelocityVerletKernel(std::span<Ball> balls, const vec2f& accel, float deltaTime) {
+        // the field is uniform, so a(t + dt) == a(t) and the velocity half-kicks fold into one
+        const auto halfDeltaTime2 = 0.5f * deltaTime * deltaTime;
+        for (auto& ball : balls) {
+            const auto velocity = ball.get_velocity();
+            ball.set_position(ball.get_position() + velocity * deltaTime + accel * halfDeltaTime2);
+            ball.set_velocity(velocity + accel * deltaTime);
+        }
+    }
+
+    void PositionVerletKernel(std::span<Ball> balls, const vec2f& accel, float deltaTime) {
+        // drift-kick-drift
+        const auto halfDeltaTime = 0.5f * deltaTime;
+        for (auto& ball : balls) {
+            auto position = ball.get_position() + ball.get_velocity() * halfDeltaTime;
+            const auto velocity = ball.get_velocity() + accel * deltaTime;
+            position += velocity * halfDeltaTime;
+            ball.set_velocity(velocity);
+            ball.set_position(position);
+        }
+    }
+
+    typedef void (*IntegratorKernel)(std::span<Ball> balls, const vec2f& accel, float deltaTime);
+
+    IntegratorKernel SelectKernel(Integrator integrator) {
+        switch (integrator) {
+            case Integrator::EXPLICIT_EULER:   return ExplicitEulerKernel;
+            case Integrator::SYMPLECTIC_EULER: return SymplecticEulerKernel;
+            case Integrator::VELOCITY_VERLET:  return VelocityVerletKernel;
+            case Integrator::POSITION_VERLET:  return PositionVerletKernel;
+        }
+        return SymplecticEulerKernel;
+    }
+}
+
+const char* BallSimulator::IntegratorName(Integrator integrator) {
+    switch (integrator) {
+        case Integrator::EXPLICIT_EULER:   return "explicit-euler";
+        case Integrator::SYMPLECTIC_EULER: return "symplectic-euler";
+        case Integrator::VELOCITY_VERLET:  return "velocity-verlet";
+        case Integrator::POSITION_VERLET:  return "position-verlet";
+    }
+    return "unknown";
+}
+
+bool BallSimulator::ParseIntegrator(std::string_view name, Integrator& integrator) {
+    for (auto candidate : {
+        Integrator::EXPLICIT_EULER, Integrator::SYMPLECTIC_EULER,
+        Integrator::VELOCITY_VERLET, Integrator::POSITION_VERLET
+    }) {
+        if (name == IntegratorName(candidate)) {
+            integrator = candidate;
+            return true;
+        }
+    }
+    return false;
+}
+
+void BallSimulator::Integrate(World& world, float deltaTime) {
+    const auto kernel = SelectKernel(world.integrator());
+    const vec2f accel(0.0f, world.gravity());
+    std::span<Ball> balls = world.entities();
+
+    if (auto pool = world.pool()) {
+        pool->parallel_for(balls.size(), PARALLEL_GRAIN_SIZE, [&](std::size_t begin, std::size_t end, unsigned) {
+            kernel(balls.subspan(begin, end - begin), accel, deltaTime);
+        });
+    } else {
+        kernel(balls, accel, deltaTime);
+    }
+}
+
+double BallSimulator::TotalEnergy(const World& world) {
+    // screen space has +y pointing down, which is also the direction gravity pulls in
+    const double gravity = world.gravity();
+    const auto& entities = world.entities();
+    const auto block_energy = [&](std::size_t begin, std::size_t end) {
+        double energy = 0.0;
+        for (auto i = begin; i < end; i++) {
+            const auto& ball = entities[i];
+            const double mass = ball.mass();
+            const vec2d velocity = ball.get_velocity();
+            energy += 0.5 * mass * velocity.length2() - mass * gravity * ball.get_position().y;
+        }
+        return energy;
+    };
+
+    // fixed-size blocks summed in order, so the result doesn't depend on the thread count
+    constexpr std::size_t block = DETERMINISTIC_REDUCTION_BLOCK;
+    const auto blocks = (entities.size() + block - 1) / block;
+    if (auto pool = world.pool(); pool != nullptr && blocks > 1) {
+        std::vector<double> partials(blocks);
+        pool->parallel_for(blocks, 1, [&](std::size_t begin, std::size_t end, unsigned) {
+            for (auto i = begin; i < end; i++) {
+                partials[i] = block_energy(i * block, std::min((i + 1) * block, entities.size()));
+            }
+        });
+
+        double energy = 0.0;
+        for (auto partial : partials) {
+            energy += partial;
+        }
+        return energy;
+    }
+
+    double energy = 0.0;
+    for (std::size_t i = 0; i < blocks; i++) {
+        energy += block_energy(i * block, std::min((i + 1) * block, entities.size()));
+    }
+    return energy;
+}
+
+void EnergyMonitor::reset(const World& world) {
+    _initial = _current = TotalEnergy(world);
+    _simulatedTime = 0.0;
+}
+
+void EnergyMonitor::sample(const World& world, double deltaTime) {
+    _current = TotalEnergy(world);
+    _simulatedTime += deltaTime * SIMULATION_TIMESCALE;
+}
+
+double EnergyMonitor::drift_per_second() const {
+    return _simulatedTime > 0.0 ? drift() / _simulatedTime : 0.0;
+}
+
+double EnergyMonitor::relative_drift_per_second() const {
+    return _initial != 0.0 ? drift_per_second() / std::abs(_initial) : 0.0;
+}
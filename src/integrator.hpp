@@ -0,0 +1,44 @@
+#pragma once
+
+#include <string_view>
+
+namespace BallSimulator {
+    class World;
+
+    // Explicit Euler is kept as the (cheapest, least accurate) reference point. Symplectic
+    // Euler matches the original per-ball update and is the default. Under a uniform field
+    // both Verlet variants are exact between contacts, so their energy error comes from
+    // collision and boundary response alone.
+    enum class Integrator {
+        EXPLICIT_EULER, SYMPLECTIC_EULER, VELOCITY_VERLET, POSITION_VERLET
+    };
+
+    const char* IntegratorName(Integrator integrator);
+    bool ParseIntegrator(std::string_view name, Integrator& integrator);
+
+    // advance every ball in the world by deltaTime using the world's integrator
+    void Integrate(World& world, float deltaTime);
+
+    // total kinetic + gravitational potential energy, accumulated in double precision
+    double TotalEnergy(const World& world);
+
+    class EnergyMonitor {
+        double _initial = 0.0;
+        double _current = 0.0;
+        double _simulatedTime = 0.0;
+
+    public:
+        void reset(const World& world);
+
+        // deltaTime is in the same (unscaled) units passed to the step functions
+        void sample(const World& world, double deltaTime);
+
+        inline constexpr double initial() const { return _initial; }
+        inline constexpr double current() const { return _current; }
+        inline constexpr double simulated_time() const { return _simulatedTime; }
+        inline constexpr double drift() const { return _current - _initial; }
+
+        double drift_per_second() const;
+        double relative_drift_per_second() const;
+    };
+}
@@ -1,7 +1,31 @@
 #include "ballsimulatorgl.hpp"
 #include <SDL3/SDL_main.h>
 
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+
 int main(int argc, char* argv[]) {
     BallSimulatorGl app;
+    for (int i = 1; i < argc; i++) {
+        if (std::strcmp(argv[i], "--replay") == 0 && i + 1 < argc) {
+            if (!app.load_trajectory(argv[++i])) {
+                return 1;
+            }
+        } else if (std::strcmp(argv[i], "--speed") == 0 && i + 1 < argc) {
+            app.set_playback_speed(std::atof(argv[++i]));
+        } else if (std::strcmp(argv[i], "--physics-rate") == 0 && i + 1 < argc) {
+            const auto rate = std::atof(argv[++i]);
+            if (!std::isfinite(rate) || rate <= 0.0) {
+                std::cerr << "--physics-rate must be a positive number of steps per second" << std::endl;
+                return 1;
+            }
+            app.set_physics_rate(rate);
+        } else {
+            std::cerr << "Usage: " << argv[0] << " [--replay trajectory] [--speed multiplier] [--physics-rate steps-per-second]" << std::endl;
+            return 1;
+        }
+    }
     return app.run();
 }
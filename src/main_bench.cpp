@@ -0,0 +1,593 @@
+#include "config.h"
+#include "benchmark.hpp"
+#include "allocations.hpp"
+#include "simulator.hpp"
+#include "scenario.hpp"
+#include "ball.hpp"
+#include "world.hpp"
+#include "random.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <iterator>
+#include <string>
+#include <utility>
+#include <vector>
+
+using namespace BallSimulator;
+
+namespace {
+    constexpr float BallRadius = 2.0f;
+    constexpr float BallSpeed = 5.0f;
+    constexpr float StepTime = 1.0f / static_cast<float>(PHYSICS_STEP_RATE);
+    constexpr std::size_t CollidePairs = 4096;
+    // the brute force step is quadratic, so it stops here rather than running for hours
+    constexpr std::size_t SimpleStepMaxBalls = 10000;
+
+    // fraction of the world covered by balls
+    constexpr float Densities[] = { 0.05f, 0.2f, 0.5f };
+    constexpr float LayoutDensity = 0.2f;
+
+    constexpr ScenarioLayout Layouts[] = {
+        ScenarioLayout::UNIFORM, ScenarioLayout::CLUSTERED, ScenarioLayout::SPLIT_LINES,
+        ScenarioLayout::CRYSTAL, ScenarioLayout::BIMODAL, ScenarioLayout::GIANT
+    };
+
+    struct BenchOptions {
+        std::size_t minBalls = 100;
+        std::size_t maxBalls = 1000000;
+        std::size_t layoutBalls = 10000;
+        unsigned deterministicThreads = 2;  // none skips the deterministic overhead case
+        std::string filter;
+        std::string jsonPath;
+        std::string baselinePath;
+        double tolerance = BENCHMARK_REGRESSION_TOLERANCE;
+    };
+
+    // a scaling study runs one world at 1, 2, 4, ... threads up to maxThreads, holding the
+    // ball count fixed (strong scaling) and growing it with the threads (weak scaling)
+    struct ScalingOptions {
+        unsigned maxThreads = 0;    // none runs no study
+        std::size_t balls = 20000;  // in total for strong scaling, per thread for weak
+        ThreadingMode mode = ThreadingMode::SHARED_TREE;
+        std::string csvPath;
+    };
+
+    // a world stepped in each threading mode, counting the heap use of its steps once it has
+    // warmed up; modes that promise a step free of allocations fail the run if it isn't
+    struct AllocationOptions {
+        bool enabled = false;
+        std::size_t balls = 10000;
+        unsigned threads = 2;
+        int warmup = ALLOCATION_WARMUP_STEPS;
+        int steps = ALLOCATION_MEASURED_STEPS;
+    };
+
+    // one thread count of a study; times are per step, in seconds
+    struct ScalingRow {
+        unsigned threads = 1;
+        std::size_t balls = 0;
+        double step = 0.0;          // median
+        StepPhases phases;          // mean of every step run, warm-up included
+        double imbalance = 1.0;     // busiest thread / mean thread, over the parallel regions
+    };
+
+    inline bool Selected(const BenchOptions& options, const std::string& name) {
+        return options.filter.empty() || name.find(options.filter) != std::string::npos;
+    }
+
+    // densities print as the percentage, which keeps names free of float formatting
+    std::string DensityName(std::size_t balls, float density) {
+        return "/balls:" + std::to_string(balls) + "/density:" + std::to_string(static_cast<int>(std::lround(density * 100.0f)));
+    }
+
+    std::string LayoutName(ScenarioLayout layout, std::size_t balls) {
+        return std::string("/layout:") + ScenarioLayoutName(layout) + "/balls:" + std::to_string(balls);
+    }
+
+    // a square world holding balls balls of BallRadius that would cover density of it if
+    // spread out evenly
+    ScenarioParameters Parameters(std::size_t balls, float density, ScenarioLayout layout = ScenarioLayout::UNIFORM) {
+        const auto area = static_cast<float>(balls) * 3.1415926f * BallRadius * BallRadius / density;
+        ScenarioParameters parameters;
+        parameters.balls = balls;
+        parameters.radius = { Distribution::CONSTANT, BallRadius };
+        parameters.mass = { Distribution::CONSTANT, 1.0f };
+        parameters.maxSpeed = BallSpeed;
+        parameters.bounds = { 0.0f, 0.0f, std::sqrt(area), std::sqrt(area) };
+        parameters.gravity = 0.0f;
+        parameters.layout = layout;
+        return parameters;
+    }
+
+    // pairs of balls from a uniform spread of distances, half of them touching, so both the
+    // early out and the full response get their share. every iteration starts by restoring
+    // the pairs, which is part of what gets timed
+    void BenchmarkCollide(BenchmarkRunner& runner, const BenchOptions& options) {
+        const auto name = "ball_collide/pairs:" + std::to_string(CollidePairs);
+        if (!Selected(options, name)) {
+            return;
+        }
+
+        const Philox random(SIMULATION_SEED);
+        std::vector<Ball> pairs;
+        pairs.reserve(CollidePairs * 2);
+        for (std::size_t i = 0; i < CollidePairs; i++) {
+            const auto bits = random(i, static_cast<std::uint32_t>(RandomStream::POSITION));
+            const auto distance = 4.0f * BallRadius * Philox::uniform(bits[0]);
+            const auto angle = 2.0f * 3.1415926f * Philox::uniform(bits[1]);
+            const auto direction = vec2f(std::cos(angle), std::sin(angle));
+            pairs.emplace_back(1.0f, BallRadius, vec2f::zero(), direction * BallSpeed);
+            pairs.emplace_back(1.0f, BallRadius, direction * distance, direction * -BallSpeed);
+        }
+
+        std::vector<Ball> scratch(pairs);
+        runner.print(std::cout, runner.run(name, CollidePairs, [&] {
+            std::copy(std::begin(pairs), std::end(pairs), std::begin(scratch));
+            for (std::size_t i = 0; i < scratch.size(); i += 2) {
+                scratch[i].collide(scratch[i + 1]);
+            }
+            KeepResult(scratch);
+        }));
+    }
+
+    // suffix names the world in the benchmark names
+    void BenchmarkWorld(BenchmarkRunner& runner, const BenchOptions& options, const ScenarioParameters& parameters,
+        const std::string& suffix) {
+        const auto build = "quadtree_build" + suffix;
+        const auto retrieve = "quadtree_retrieve" + suffix;
+        const auto stepQuadtree = "step_quadtree" + suffix;
+        const auto stepSimple = "step_simple" + suffix;
+        const auto simple = parameters.balls <= SimpleStepMaxBalls && Selected(options, stepSimple);
+        if (!Selected(options, build) && !Selected(options, retrieve) && !Selected(options, stepQuadtree) && !simple) {
+            return;
+        }
+
+        World world;
+        BuildScenario(world, parameters);
+        auto& entities = world.entities();
+        const auto balls = entities.size();
+
+        CollisionQuadtree tree(0, world.bounds());
+        const auto insert_all = [&] {
+            tree.clear();
+            for (auto& ball : entities) {
+                tree.insert(std::ref(ball));
+            }
+        };
+        if (Selected(options, build)) {
+            runner.print(std::cout, runner.run(build, balls, [&] {
+                insert_all();
+                KeepResult(tree);
+            }));
+        }
+        if (Selected(options, retrieve)) {
+            insert_all();
+            std::vector<CollisionQuadtree::RefT> candidates;
+            runner.print(std::cout, runner.run(retrieve, balls, [&] {
+                for (auto& ball : entities) {
+                    tree.retrieve(candidates, std::ref(ball));
+                    KeepResult(candidates);
+                    candidates.clear();
+                }
+            }));
+        }
+
+        // the steps run on the evolving world, which settles into a steady gas
+        if (Selected(options, stepQuadtree)) {
+            runner.print(std::cout, runner.run(stepQuadtree, balls, [&] {
+                DoQuadtreeCollisionDetection(world, StepTime);
+            }));
+        }
+        if (simple) {
+            runner.print(std::cout, runner.run(stepSimple, balls, [&] {
+                DoSimpleCollisionDetection(world, StepTime);
+            }));
+        }
+    }
+
+    // the same world stepped at the same thread count with and without a deterministic contact
+    // order, so the ratio of the two is what the ordering costs; it uses the layout ball count
+    void BenchmarkDeterminism(BenchmarkRunner& runner, const BenchOptions& options) {
+        const auto balls = options.layoutBalls;
+        const auto suffix = "/threads:" + std::to_string(options.deterministicThreads) + "/balls:" + std::to_string(balls);
+        const auto shared = "step_shared" + suffix;
+        const auto deterministic = "step_deterministic" + suffix;
+        if (options.deterministicThreads == 0 || balls == 0 ||
+            (!Selected(options, shared) && !Selected(options, deterministic))) {
+            return;
+        }
+
+        double medians[2] = {};
+        for (const auto ordered : { false, true }) {
+            World world;
+            BuildScenario(world, Parameters(balls, LayoutDensity));
+            world.set_threads(options.deterministicThreads);
+            world.set_deterministic(ordered);
+            const auto& result = runner.run(ordered ? deterministic : shared, balls, [&] {
+                DoQuadtreeCollisionDetection(world, StepTime);
+            });
+            runner.print(std::cout, result);
+            medians[ordered ? 1 : 0] = result.median;
+        }
+        if (medians[0] > 0.0 && medians[1] > 0.0) {
+            std::cout << "Deterministic overhead at " << options.deterministicThreads << " threads: "
+                << medians[1] / medians[0] << "x the step time" << std::endl;
+        }
+    }
+
+    std::vector<unsigned> ThreadCounts(unsigned maxThreads) {
+        std::vector<unsigned> counts;
+        for (unsigned threads = 1; threads < maxThreads; threads *= 2) {
+            counts.push_back(threads);
+        }
+        counts.push_back(maxThreads);
+        return counts;
+    }
+
+    // how much faster than one thread: plainly for strong scaling, and for weak scaling scaled
+    // by the threads, as each of them did a one-thread run's worth of work
+    inline double Speedup(double single, double time, unsigned threads, bool weak) {
+        return time > 0.0 ? (weak ? threads : 1u) * single / time : 0.0;
+    }
+
+    inline double Collide(const StepPhases& phases) {
+        return phases.contacts.seconds + phases.resolve.seconds + phases.boundaries.seconds;
+    }
+
+    // busy time of a thread is what it spent in pool jobs. work-stealing runs inside a pool job
+    // on the same threads, so the time its workers spent waiting for tasks is taken back out
+    double Imbalance(const World& world) {
+        const auto* pool = world.pool();
+        if (pool == nullptr) {
+            return 1.0;
+        }
+        std::vector<double> busy(std::begin(pool->busy_seconds()), std::end(pool->busy_seconds()));
+        if (const auto* scheduler = world.scheduler()) {
+            const auto stats = scheduler->stats();
+            for (std::size_t i = 0; i < busy.size() && i < stats.size(); i++) {
+                busy[i] = std::max(busy[i] - stats[i].idleSeconds, 0.0);
+            }
+        }
+        auto total = 0.0, busiest = 0.0;
+        for (const auto seconds : busy) {
+            total += seconds;
+            busiest = std::max(busiest, seconds);
+        }
+        return total > 0.0 ? busiest * static_cast<double>(busy.size()) / total : 1.0;
+    }
+
+    std::vector<ScalingRow> RunScaling(BenchmarkRunner& runner, const ScalingOptions& options, bool weak) {
+        std::vector<ScalingRow> rows;
+        for (const auto threads : ThreadCounts(options.maxThreads)) {
+            ScalingRow row;
+            row.threads = threads;
+            row.balls = weak ? options.balls * threads : options.balls;
+
+            // every thread count starts from the same world
+            World world;
+            BuildScenario(world, Parameters(row.balls, LayoutDensity));
+            world.set_threads(threads);
+            world.set_threading_mode(options.mode);
+
+            // the first step sizes the tree and the scratch buffers; only what follows is measured
+            DoQuadtreeCollisionDetection(world, StepTime);
+            world.phases() = {};
+            if (auto* pool = world.pool()) {
+                pool->reset_stats();
+            }
+            if (options.mode == ThreadingMode::WORK_STEALING && threads > 1) {
+                world.scheduler().reset_stats();
+            }
+
+            const auto name = std::string(weak ? "scaling_weak" : "scaling_strong") + "/threading:" +
+                ThreadingModeName(options.mode) + "/threads:" + std::to_string(threads) + "/balls:" + std::to_string(row.balls);
+            const auto& result = runner.run(name, row.balls, [&] {
+                DoQuadtreeCollisionDetection(world, StepTime);
+            });
+            runner.print(std::cout, result);
+
+            const auto& phases = world.phases();
+            const auto steps = static_cast<double>(std::max<std::uint64_t>(phases.steps, 1));
+            row.step = result.median;
+            row.phases.integrate.seconds = phases.integrate.seconds / steps;
+            row.phases.build.seconds = phases.build.seconds / steps;
+            row.phases.contacts.seconds = phases.contacts.seconds / steps;
+            row.phases.resolve.seconds = phases.resolve.seconds / steps;
+            row.phases.boundaries.seconds = phases.boundaries.seconds / steps;
+            row.phases.steps = phases.steps;
+            row.imbalance = Imbalance(world);
+            rows.push_back(row);
+        }
+        return rows;
+    }
+
+    // speedups and efficiencies are against the one-thread row, which runs the serial step.
+    // that step fuses contacts, resolution and boundaries, so they are compared as one phase
+    void PrintScaling(std::ostream& out, const std::vector<ScalingRow>& rows, bool weak) {
+        const auto flags = out.flags();
+        const auto& single = rows.front();
+        out << std::left << std::setw(9) << "threads" << std::right << std::setw(10) << "balls" << std::setw(12) << "ms/step"
+            << std::setw(10) << "speedup" << std::setw(12) << "efficiency" << std::setw(11) << "integrate"
+            << std::setw(9) << "build" << std::setw(9) << "collide" << std::setw(11) << "imbalance" << std::endl;
+        out << std::fixed;
+        for (const auto& row : rows) {
+            const auto speedup = Speedup(single.step, row.step, row.threads, weak);
+            out << std::left << std::setw(9) << row.threads << std::right << std::setw(10) << row.balls
+                << std::setprecision(3) << std::setw(12) << row.step * 1000.0
+                << std::setprecision(2) << std::setw(9) << speedup << "x"
+                << std::setprecision(1) << std::setw(11) << 100.0 * speedup / row.threads << "%"
+                << std::setprecision(2)
+                << std::setw(10) << Speedup(single.phases.integrate.seconds, row.phases.integrate.seconds, row.threads, weak) << "x"
+                << std::setw(8) << Speedup(single.phases.build.seconds, row.phases.build.seconds, row.threads, weak) << "x"
+                << std::setw(8) << Speedup(Collide(single.phases), Collide(row.phases), row.threads, weak) << "x"
+                << std::setw(11) << row.imbalance << std::endl;
+        }
+        out.flags(flags);
+    }
+
+    // one line per thread count of both studies, to keep alongside each release
+    void WriteScalingCsv(std::ostream& out, const std::vector<ScalingRow>& rows, bool weak, bool header) {
+        const auto flags = out.flags();
+        if (header) {
+            out << "study,threads,balls,step_ns,speedup,efficiency,integrate_ns,build_ns,contacts_ns,resolve_ns,"
+                "boundaries_ns,integrate_speedup,build_speedup,collide_speedup,imbalance\n";
+        }
+        out << std::setprecision(9);
+        const auto& single = rows.front();
+        for (const auto& row : rows) {
+            const auto speedup = Speedup(single.step, row.step, row.threads, weak);
+            out << (weak ? "weak" : "strong") << ',' << row.threads << ',' << row.balls << ',' << row.step * 1e9 << ','
+                << speedup << ',' << speedup / row.threads << ','
+                << row.phases.integrate.seconds * 1e9 << ',' << row.phases.build.seconds * 1e9 << ',' << row.phases.contacts.seconds * 1e9 << ','
+                << row.phases.resolve.seconds * 1e9 << ',' << row.phases.boundaries.seconds * 1e9 << ','
+                << Speedup(single.phases.integrate.seconds, row.phases.integrate.seconds, row.threads, weak) << ','
+                << Speedup(single.phases.build.seconds, row.phases.build.seconds, row.threads, weak) << ','
+                << Speedup(Collide(single.phases), Collide(row.phases), row.threads, weak) << ','
+                << row.imbalance << '\n';
+        }
+        out.flags(flags);
+    }
+
+    bool RunScalingStudies(BenchmarkRunner& runner, const ScalingOptions& options) {
+        std::ofstream csv;
+        if (!options.csvPath.empty()) {
+            csv.open(options.csvPath);
+        }
+        for (const auto weak : { false, true }) {
+            std::cout << (weak ? "Weak" : "Strong") << " scaling, " << options.balls << " balls"
+                << (weak ? " per thread" : "") << ", " << ThreadingModeName(options.mode) << " threading" << std::endl;
+            const auto rows = RunScaling(runner, options, weak);
+            PrintScaling(std::cout, rows, weak);
+            if (csv.is_open()) {
+                WriteScalingCsv(csv, rows, weak, !weak);
+            }
+        }
+        if (!options.csvPath.empty() && !csv) {
+            std::cerr << "Couldn't write " << options.csvPath << std::endl;
+            return false;
+        }
+        return true;
+    }
+
+    // once warm, every threading mode reuses every buffer between steps: tree nodes and their
+    // items come from an arena the tree keeps, so a warmed up step doesn't touch the heap
+    struct AllocationCase {
+        const char* name;
+        unsigned threads;
+        ThreadingMode mode;
+        bool deterministic;
+    };
+
+    // peak is how far the heap grew above where the phase started, in the worst step, and
+    // live how much of it was in use at once
+    void PrintPhaseHeap(const char* name, const PhaseStats& phase, double steps) {
+        std::cout << "  " << std::left << std::setw(12) << name << std::right << std::setw(10)
+            << static_cast<double>(phase.allocations) / steps << " allocations " << std::setw(12)
+            << static_cast<double>(phase.bytes) / steps << " bytes, peak " << std::setw(8) << phase.peak
+            << " bytes, live " << std::setw(10) << phase.livePeak << " bytes" << std::endl;
+    }
+
+    bool RunAllocationCounts(const AllocationOptions& options) {
+        if (!AllocationsCounted) {
+            std::cerr << "This build doesn't count allocations, configure it with -DBALLSIMULATOR_COUNT_ALLOCATIONS=ON" << std::endl;
+            return false;
+        }
+
+        const AllocationCase cases[] = {
+            { "serial", 1, ThreadingMode::SHARED_TREE, false },
+            { "shared deterministic", options.threads, ThreadingMode::SHARED_TREE, true },
+            { "shared", options.threads, ThreadingMode::SHARED_TREE, false },
+            { "domain", options.threads, ThreadingMode::DOMAIN_DECOMPOSITION, false },
+            { "stealing", options.threads, ThreadingMode::WORK_STEALING, false }
+        };
+
+        std::cout << "Allocations per step, " << options.balls << " balls, " << options.steps << " steps after "
+            << options.warmup << " warm-up steps" << std::endl;
+        const auto flags = std::cout.flags();
+        std::cout << std::fixed << std::setprecision(2);
+        auto passed = true;
+        for (const auto& test : cases) {
+            // the warm-up runs another seed of the same gas, so the buffers and tree arenas it
+            // grows are sized for crowds like the measured ones without ever seeing those steps
+            auto parameters = Parameters(options.balls, LayoutDensity);
+            parameters.seed = SIMULATION_SEED + 1;
+            World world;
+            BuildScenario(world, parameters);
+            world.set_threads(test.threads);
+            world.set_threading_mode(test.mode);
+            world.set_deterministic(test.deterministic);
+            for (auto i = 0; i < options.warmup; i++) {
+                DoQuadtreeCollisionDetection(world, StepTime);
+            }
+
+            // the first step from the measured start still meets new crowds, so it is told apart
+            parameters.seed = SIMULATION_SEED;
+            BuildScenario(world, parameters);
+            auto before = CountAllocations();
+            DoQuadtreeCollisionDetection(world, StepTime);
+            const auto cold = CountAllocations().allocations - before.allocations;
+
+            world.phases() = {};
+            before = CountAllocations();
+            for (auto i = 0; i < options.steps; i++) {
+                DoQuadtreeCollisionDetection(world, StepTime);
+            }
+            const auto after = CountAllocations();
+
+            const auto steps = static_cast<double>(std::max(options.steps, 1));
+            const auto allocations = static_cast<double>(after.allocations - before.allocations) / steps;
+            const auto& phases = world.phases();
+            const auto failed = after.allocations != before.allocations;
+            const auto live = std::max({ phases.integrate.livePeak, phases.build.livePeak, phases.contacts.livePeak,
+                phases.resolve.livePeak, phases.boundaries.livePeak });
+            passed = passed && !failed;
+            std::cout << test.name << ", " << test.threads << (test.threads == 1 ? " thread: " : " threads: ")
+                << cold << " allocations in the first step, then " << allocations << " allocations, "
+                << static_cast<double>(after.bytes - before.bytes) / steps << " bytes per step, "
+                << live << " bytes live at most" << (failed ? " (FAILED, expected none)" : " (ok)") << std::endl;
+
+            PrintPhaseHeap("integrate", phases.integrate, steps);
+            PrintPhaseHeap("build", phases.build, steps);
+            PrintPhaseHeap("contacts", phases.contacts, steps);
+            PrintPhaseHeap("resolve", phases.resolve, steps);
+            PrintPhaseHeap("boundaries", phases.boundaries, steps);
+        }
+        std::cout.flags(flags);
+        return passed;
+    }
+}
+
+int main(int argc, char* argv[]) {
+    BenchmarkOptions benchmarkOptions;
+    BenchOptions options;
+    ScalingOptions scaling;
+    AllocationOptions allocations;
+
+    for (auto i = 1; i < argc; i++) {
+        if (std::strcmp(argv[i], "--warmup") == 0 && i + 1 < argc) {
+            benchmarkOptions.warmup = std::max(std::atoi(argv[++i]), 0);
+        } else if (std::strcmp(argv[i], "--repetitions") == 0 && i + 1 < argc) {
+            benchmarkOptions.repetitions = std::max(std::atoi(argv[++i]), 2);
+        } else if (std::strcmp(argv[i], "--min-sample") == 0 && i + 1 < argc) {
+            benchmarkOptions.minSampleSeconds = std::max(std::atof(argv[++i]), 0.0);
+        } else if (std::strcmp(argv[i], "--min-balls") == 0 && i + 1 < argc) {
+            options.minBalls = std::max<std::size_t>(std::strtoull(argv[++i], nullptr, 10), 1);
+        } else if (std::strcmp(argv[i], "--max-balls") == 0 && i + 1 < argc) {
+            options.maxBalls = std::strtoull(argv[++i], nullptr, 10);
+        } else if (std::strcmp(argv[i], "--layout-balls") == 0 && i + 1 < argc) {
+            options.layoutBalls = std::strtoull(argv[++i], nullptr, 10);
+        } else if (std::strcmp(argv[i], "--deterministic-threads") == 0 && i + 1 < argc) {
+            options.deterministicThreads = static_cast<unsigned>(std::max(std::atoi(argv[++i]), 0));
+        } else if (std::strcmp(argv[i], "--filter") == 0 && i + 1 < argc) {
+            options.filter = argv[++i];
+        } else if (std::strcmp(argv[i], "--json") == 0 && i + 1 < argc) {
+            options.jsonPath = argv[++i];
+        } else if (std::strcmp(argv[i], "--baseline") == 0 && i + 1 < argc) {
+            options.baselinePath = argv[++i];
+        } else if (std::strcmp(argv[i], "--tolerance") == 0 && i + 1 < argc) {
+            options.tolerance = std::max(std::atof(argv[++i]), 0.0);
+        } else if (std::strcmp(argv[i], "--scaling") == 0 && i + 1 < argc) {
+            const auto count = std::atoi(argv[++i]);
+            scaling.maxThreads = count > 0 ? static_cast<unsigned>(count) : ThreadPool::hardware_threads();
+        } else if (std::strcmp(argv[i], "--scaling-balls") == 0 && i + 1 < argc) {
+            scaling.balls = std::max<std::size_t>(std::strtoull(argv[++i], nullptr, 10), 1);
+        } else if (std::strcmp(argv[i], "--threading") == 0 && i + 1 < argc) {
+            if (!ParseThreadingMode(argv[++i], scaling.mode)) {
+                std::cerr << "Unknown threading mode " << argv[i] << std::endl;
+                return 1;
+            }
+        } else if (std::strcmp(argv[i], "--csv") == 0 && i + 1 < argc) {
+            scaling.csvPath = argv[++i];
+        } else if (std::strcmp(argv[i], "--allocations") == 0) {
+            allocations.enabled = true;
+        } else if (std::strcmp(argv[i], "--allocation-balls") == 0 && i + 1 < argc) {
+            allocations.balls = std::max<std::size_t>(std::strtoull(argv[++i], nullptr, 10), 1);
+        } else if (std::strcmp(argv[i], "--allocation-threads") == 0 && i + 1 < argc) {
+            const auto count = std::atoi(argv[++i]);
+            allocations.threads = count > 0 ? static_cast<unsigned>(count) : ThreadPool::hardware_threads();
+        } else if (std::strcmp(argv[i], "--allocation-warmup") == 0 && i + 1 < argc) {
+            allocations.warmup = std::max(std::atoi(argv[++i]), 0);
+        } else if (std::strcmp(argv[i], "--allocation-steps") == 0 && i + 1 < argc) {
+            allocations.steps = std::max(std::atoi(argv[++i]), 1);
+        } else {
+            std::cerr << "Usage: " << argv[0] << " [--warmup runs] [--repetitions samples] [--min-sample seconds]"
+                " [--min-balls count] [--max-balls count] [--layout-balls count] [--deterministic-threads count]"
+                " [--filter text] [--json file]"
+                " [--baseline file [--tolerance fraction]]"
+                " [--scaling max-threads [--scaling-balls count] [--threading shared|domain|stealing] [--csv file]]"
+                " [--allocations [--allocation-balls count] [--allocation-threads count]"
+                " [--allocation-warmup steps] [--allocation-steps steps]]" << std::endl;
+            return 1;
+        }
+    }
+
+    if (allocations.enabled) {
+        return RunAllocationCounts(allocations) ? 0 : 1;
+    }
+
+    // read before anything runs, so a bad baseline doesn't waste a whole run
+    std::vector<BenchmarkBaseline> baselines;
+    if (!options.baselinePath.empty()) {
+        std::ifstream in(options.baselinePath, std::ios::binary);
+        const std::string text((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+        std::string error;
+        if (!in.is_open() || !ParseBaselines(text, baselines, error)) {
+            std::cerr << "Couldn't read the baseline " << options.baselinePath
+                << (in.is_open() ? ": " + error : std::string()) << std::endl;
+            return 1;
+        }
+    }
+
+    std::cout << "Warm-up " << benchmarkOptions.warmup << ", " << benchmarkOptions.repetitions
+        << " samples of at least " << benchmarkOptions.minSampleSeconds << "s, times per iteration" << std::endl;
+
+    BenchmarkRunner runner(benchmarkOptions);
+    if (scaling.maxThreads > 0) {
+        if (!RunScalingStudies(runner, scaling)) {
+            return 1;
+        }
+    } else {
+        BenchmarkCollide(runner, options);
+        for (auto balls = options.minBalls; balls <= options.maxBalls; balls *= 10) {
+            for (const auto density : Densities) {
+                BenchmarkWorld(runner, options, Parameters(balls, density), DensityName(balls, density));
+            }
+        }
+        // the same ball count laid out in each of the ways that trouble the quadtree
+        if (options.layoutBalls > 0) {
+            for (const auto layout : Layouts) {
+                BenchmarkWorld(runner, options, Parameters(options.layoutBalls, LayoutDensity, layout),
+                    LayoutName(layout, options.layoutBalls));
+            }
+        }
+        BenchmarkDeterminism(runner, options);
+    }
+
+    if (!options.jsonPath.empty()) {
+        std::ofstream out(options.jsonPath);
+        runner.write_json(out);
+        if (!out) {
+            std::cerr << "Couldn't write " << options.jsonPath << std::endl;
+            return 1;
+        }
+    }
+
+    if (!options.baselinePath.empty()) {
+        const auto comparisons = CompareBaselines(baselines, runner.results(), options.tolerance);
+        std::cout << "Against " << options.baselinePath << ", tolerance " << 100.0 * options.tolerance << "%:" << std::endl;
+        PrintComparison(std::cout, comparisons);
+        const auto regressed = std::any_of(std::begin(comparisons), std::end(comparisons), [](const BenchmarkComparison& comparison) {
+            return comparison.change == BenchmarkChange::REGRESSED;
+        });
+        if (regressed) {
+            return 1;
+        }
+    }
+    return 0;
+}
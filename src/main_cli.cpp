@@ -1,25 +1,737 @@
 #include "config.h"
 #include "simulator.hpp"
+#include "integrator.hpp"
 #include "ball.hpp"
 #include "world.hpp"
+#include "batch.hpp"
+#include "processdomain.hpp"
+#include "shmtransport.hpp"
+#include "scenario.hpp"
+#include "checkpoint.hpp"
+#include "trajectorywriter.hpp"
+#include "trajectoryreader.hpp"
+
+#include <algorithm>
+#include <bit>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <limits>
+#include <memory>
+#include <span>
+#include <string>
+#include <utility>
+#include <vector>
+
+#ifdef HAVE_SHARED_MEMORY_TRANSPORT
+#include <csignal>
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
 
 using namespace BallSimulator;
 
-int main() {
-    World world;
-    world.resize({ 0, 0, 1024, 1024 });
+namespace {
+    struct RunResult {
+        double seconds = 0.0;
+        double drift = 0.0;
+        double relativeDrift = 0.0;
+        long long substeps = 0;
+        float minSubstepDeltaTime = 0.0f;
+    };
+
+    // what a single world run writes out along the way
+    struct RunOutput {
+        Checkpointer* checkpointer = nullptr;
+        std::uint64_t checkpointInterval = 0;
+        TrajectoryWriter* trajectory = nullptr;
+        std::uint64_t recordInterval = 1;
+    };
+
+    // steps are numbered on from firstStep, and checkpoints and trajectory frames are taken
+    // whenever that number reaches a multiple of their interval
+    RunResult Run(World& world, int steps, float deltaTime, StepFunction step, std::uint64_t firstStep = 0,
+        const RunOutput& output = {}) {
+        RunResult result;
+        result.minSubstepDeltaTime = deltaTime;
+
+        EnergyMonitor energy;
+        energy.reset(world);
+
+        const auto start = std::chrono::steady_clock::now();
+        if (output.trajectory != nullptr) {
+            output.trajectory->record(world);
+        }
+        for (auto i = 1; i <= steps; i++) {
+            auto info = DoAdaptiveStep(world, deltaTime, step);
+            result.substeps += info.substeps;
+            result.minSubstepDeltaTime = std::min(result.minSubstepDeltaTime, info.deltaTime);
+            if (output.trajectory != nullptr && (firstStep + i) % output.recordInterval == 0) {
+                output.trajectory->record(world);
+            }
+            if (output.checkpointer != nullptr && (firstStep + i) % output.checkpointInterval == 0) {
+                output.checkpointer->capture(world, firstStep + i);
+            }
+        }
+        result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+        energy.sample(world, static_cast<double>(deltaTime) * steps);
+        result.drift = energy.drift_per_second();
+        result.relativeDrift = energy.relative_drift_per_second();
+        return result;
+    }
+
+    // steps up to WorldBatch::Lanes worlds in lockstep, one world per vector lane; worlds that
+    // don't fit together in a batch are stepped one at a time with step instead
+    void RunBatch(std::span<World> worlds, std::span<RunResult> results, int steps, float deltaTime, StepFunction step) {
+        WorldBatch batch;
+        if (!batch.load(worlds)) {
+            for (std::size_t i = 0; i < worlds.size(); i++) {
+                results[i] = Run(worlds[i], steps, deltaTime, step);
+            }
+            return;
+        }
+
+        std::vector<EnergyMonitor> energy(worlds.size());
+        for (std::size_t i = 0; i < worlds.size(); i++) {
+            energy[i].reset(worlds[i]);
+        }
+
+        long long substeps = 0;
+        float minSubstepDeltaTime = deltaTime;
+        const auto start = std::chrono::steady_clock::now();
+        for (auto i = 1; i <= steps; i++) {
+            auto info = batch.step(deltaTime);
+            substeps += info.substeps;
+            minSubstepDeltaTime = std::min(minSubstepDeltaTime, info.deltaTime);
+        }
+        const auto elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+        batch.store(worlds);
+        for (std::size_t i = 0; i < worlds.size(); i++) {
+            energy[i].sample(worlds[i], static_cast<double>(deltaTime) * steps);
+            results[i].seconds = elapsed / static_cast<double>(worlds.size());
+            results[i].drift = energy[i].drift_per_second();
+            results[i].relativeDrift = energy[i].relative_drift_per_second();
+            results[i].substeps = substeps;
+            results[i].minSubstepDeltaTime = minSubstepDeltaTime;
+        }
+    }
+
+    // steps many small worlds side by side, a whole world per pool thread at a time; each world
+    // stays single threaded since twenty balls are far too few to split up any further
+    template <typename F>
+    int RunEnsemble(std::size_t count, unsigned threads, bool batched, int steps, float deltaTime, StepFunction step, F&& setup) {
+        std::vector<World> worlds(count);
+        std::vector<RunResult> results(count);
+        for (std::size_t i = 0; i < count; i++) {
+            setup(worlds[i], i);
+        }
+
+        ThreadPool pool(threads);
+        const auto start = std::chrono::steady_clock::now();
+        if (batched) {
+            constexpr auto lanes = WorldBatch::Lanes;
+            pool.parallel_for((count + lanes - 1) / lanes, 1, [&](std::size_t begin, std::size_t end, unsigned) {
+                for (auto i = begin; i < end; i++) {
+                    const auto first = i * lanes;
+                    const auto size = std::min(lanes, count - first);
+                    RunBatch(std::span(worlds).subspan(first, size), std::span(results).subspan(first, size),
+                        steps, deltaTime, step);
+                }
+            });
+        } else {
+            pool.parallel_for(count, 1, [&](std::size_t begin, std::size_t end, unsigned) {
+                for (auto i = begin; i < end; i++) {
+                    results[i] = Run(worlds[i], steps, deltaTime, step);
+                }
+            });
+        }
+        const auto elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+        double busy = 0.0, drift = 0.0;
+        double minDrift = results.front().relativeDrift, maxDrift = results.front().relativeDrift;
+        long long substeps = 0;
+        float minSubstepDeltaTime = deltaTime;
+        for (const auto& result : results) {
+            busy += result.seconds;
+            drift += result.drift;
+            minDrift = std::min(minDrift, result.relativeDrift);
+            maxDrift = std::max(maxDrift, result.relativeDrift);
+            substeps += result.substeps;
+            minSubstepDeltaTime = std::min(minSubstepDeltaTime, result.minSubstepDeltaTime);
+        }
+
+        const auto worldSteps = static_cast<double>(count) * steps;
+        const auto ballSteps = worldSteps * static_cast<double>(worlds.front().entities().size());
+        std::cout << "Ensemble: " << count << " worlds on " << pool.size() << " threads";
+        if (batched) {
+            std::cout << ", " << WorldBatch::Lanes << " worlds per batch";
+        }
+        std::cout << std::endl;
+        std::cout << "Wall time: " << elapsed << "s (" << (elapsed > 0.0 ? worldSteps / elapsed : 0.0)
+            << " world-steps/s, " << (elapsed > 0.0 ? ballSteps / elapsed : 0.0) << " ball-steps/s, "
+            << (elapsed > 0.0 ? 100.0 * busy / (elapsed * pool.size()) : 0.0)
+            << "% busy)" << std::endl;
+        std::cout << "Integrator: " << IntegratorName(worlds.front().integrator()) << std::endl;
+        std::cout << "Energy drift: mean " << drift / static_cast<double>(count) << "/s, relative "
+            << minDrift * 100.0 << "%/s to " << maxDrift * 100.0 << "%/s" << std::endl;
+        std::cout << "Substeps: " << substeps << " (" << static_cast<double>(substeps) / worldSteps
+            << " per step, min dt " << minSubstepDeltaTime << ")" << std::endl;
+        return 0;
+    }
+
+    // what --query asks of a trajectory: one ball over a range of frames, or every ball at one
+    struct QueryOptions {
+        std::string path;
+        bool oneBall = false;
+        std::size_t ball = 0;
+        std::uint64_t first = 0;
+        std::uint64_t last = std::numeric_limits<std::uint64_t>::max();
+        std::uint32_t columns = TrajectoryAllColumns;
+    };
+
+    bool ParseColumns(const char* name, std::uint32_t& columns) {
+        if (std::strcmp(name, "positions") == 0) {
+            columns = TrajectoryPositions;
+        } else if (std::strcmp(name, "velocities") == 0) {
+            columns = TrajectoryVelocities;
+        } else if (std::strcmp(name, "all") == 0) {
+            columns = TrajectoryAllColumns;
+        } else {
+            return false;
+        }
+        return true;
+    }
+
+    // prints the answer as csv on stdout and everything else on stderr, so it can be piped
+    int RunQuery(const QueryOptions& query) {
+        std::string error;
+        auto reader = TrajectoryReader::open(query.path, error);
+        if (reader == nullptr) {
+            std::cerr << "Couldn't read trajectory: " << error << std::endl;
+            return 1;
+        }
+        std::cerr << "Trajectory: " << reader->balls() << " balls, " << reader->frames() << " frames in "
+            << reader->chunks().size() << " chunks" << std::endl;
 
-    for (auto i = 1; i <= 20; i++) {
-        world.add(Ball(5.0f, 20.0f));
+        constexpr const char* names[TrajectoryColumns] = { "x", "y", "vx", "vy" };
+        std::cout << "frame,ball";
+        for (std::uint32_t c = 0; c < TrajectoryColumns; c++) {
+            if ((query.columns & (1u << c)) != 0) {
+                std::cout << "," << names[c];
+            }
+        }
+        std::cout << "\n";
+
+        const auto stride = static_cast<std::size_t>(std::popcount(query.columns));
+        const auto start = std::chrono::steady_clock::now();
+        std::span<const std::uint64_t> frames;
+        std::span<const float> values;
+        if (query.oneBall) {
+            if (query.ball >= reader->balls()) {
+                std::cerr << "No ball " << query.ball << " in a trajectory of " << reader->balls() << std::endl;
+                return 1;
+            }
+            const auto series = reader->series(query.ball, query.first, query.last, query.columns);
+            if (series.corrupt) {
+                std::cerr << "Frames " << query.first << " to " << query.last << " span a corrupt chunk" << std::endl;
+                return 1;
+            }
+            frames = series.frames;
+            values = series.values;
+        } else {
+            values = reader->slice(query.first, query.columns);
+            if (values.empty()) {
+                std::cerr << "Frame " << query.first << " wasn't recorded" << std::endl;
+                return 1;
+            }
+        }
+        const auto elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+        const auto rows = values.size() / stride;
+        for (std::size_t row = 0; row < rows; row++) {
+            std::cout << (query.oneBall ? frames[row] : query.first) << "," << (query.oneBall ? query.ball : row);
+            for (std::size_t c = 0; c < stride; c++) {
+                std::cout << "," << values[row * stride + c];
+            }
+            std::cout << "\n";
+        }
+        std::cout << std::flush;
+        std::cerr << "Query: " << rows << " rows in " << elapsed * 1000.0 << "ms" << std::endl;
+        return 0;
     }
 
-    for (auto i = 1; i <= 1000000; i++) {
+#ifdef HAVE_SHARED_MEMORY_TRANSPORT
+    // every report interval each rank sends its counters to rank 0, which prints one line
+    // describing the average step of that interval across the whole run
+    void ReportInterval(Transport& transport, ProcessDomain& domain, std::uint64_t firstStep, std::uint64_t lastStep) {
+        const auto ranks = transport.size();
+        if (transport.rank() != 0) {
+            const auto& stats = domain.stats();
+            transport.send(0, std::as_bytes(std::span(&stats, 1)));
+            domain.reset_stats();
+            return;
+        }
+
+        std::vector<ProcessStepStats> stats(ranks);
+        stats[0] = domain.stats();
+        std::vector<std::byte> message;
+        for (unsigned rank = 1; rank < ranks; rank++) {
+            transport.receive(rank, message);
+            std::memcpy(&stats[rank], message.data(), std::min(message.size(), sizeof(ProcessStepStats)));
+        }
+        domain.reset_stats();
+
+        const auto steps = static_cast<double>(std::max<std::uint64_t>(stats[0].steps, 1));
+        double slowest = 0.0, compute = 0.0, wait = 0.0, bytes = 0.0, halo = 0.0, migrated = 0.0;
+        for (const auto& rank : stats) {
+            slowest = std::max(slowest, rank.computeSeconds);
+            compute += rank.computeSeconds;
+            wait += rank.waitSeconds;
+            bytes += static_cast<double>(rank.bytes);
+            halo += static_cast<double>(rank.halo);
+            migrated += static_cast<double>(rank.migrated);
+        }
+        const auto mean = compute / ranks;
+
+        std::cout << "Steps " << firstStep << "-" << lastStep << ": "
+            << (stats[0].computeSeconds + stats[0].waitSeconds) * 1000.0 / steps << "ms/step, compute "
+            << mean * 1000.0 / steps << "ms mean " << slowest * 1000.0 / steps << "ms max (imbalance "
+            << (mean > 0.0 ? slowest / mean : 1.0) << "), "
+            << (compute + wait > 0.0 ? 100.0 * wait / (compute + wait) : 0.0) << "% waiting, "
+            << bytes / steps / 1024.0 << "KiB " << halo / steps << " halo " << migrated / steps
+            << " migrated per step, owned";
+        for (const auto& rank : stats) {
+            std::cout << " " << rank.owned;
+        }
+        std::cout << std::endl;
+    }
+
+    int RunRank(Transport& transport, const World& world, int steps, float deltaTime) {
+        ProcessDomain domain(transport, world);
+        const auto interval = std::max(steps / 10, 1);
+        auto firstStep = 1;
+        for (auto i = 1; i <= steps; i++) {
+            if (!domain.step(deltaTime)) {
+                std::cerr << "Rank " << transport.rank() << ": halo exchange doesn't fit in the shared memory ring" << std::endl;
+                return 1;
+            }
+            if (i % interval == 0 || i == steps) {
+                ReportInterval(transport, domain, firstStep, i);
+                firstStep = i + 1;
+            }
+        }
+        return 0;
+    }
+
+    // forks one worker process per strip of the world, all talking through one shared memory object
+    int RunProcesses(const World& world, unsigned processes, int steps, float deltaTime) {
+        auto transport = SharedMemoryTransport::create(processes, SHARED_MEMORY_RING_BYTES);
+        if (transport == nullptr) {
+            std::cerr << "Couldn't create the shared memory transport" << std::endl;
+            return 1;
+        }
+
+        std::cout << "Processes: " << processes << ", " << world.entities().size() << " balls" << std::endl;
+        std::cout.flush();
+
+        const auto start = std::chrono::steady_clock::now();
+        std::vector<pid_t> children;
+        for (unsigned rank = 0; rank < processes; rank++) {
+            const auto pid = fork();
+            if (pid == 0) {
+                transport->attach(rank);
+                const auto status = RunRank(*transport, world, steps, deltaTime);
+                std::cout.flush();
+                std::_Exit(status);
+            }
+            if (pid < 0) {
+                std::cerr << "Couldn't start worker process " << rank << std::endl;
+                for (auto child : children) {
+                    kill(child, SIGKILL);
+                }
+                break;
+            }
+            children.push_back(pid);
+        }
+
+        // the others would wait at the next barrier forever if one of them dies, so take them all down
+        auto failed = children.size() != processes;
+        for (std::size_t remaining = children.size(); remaining > 0; remaining--) {
+            int status = 0;
+            const auto pid = wait(&status);
+            if (pid < 0) {
+                break;
+            }
+            if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+                failed = true;
+                for (auto child : children) {
+                    if (child != pid) {
+                        kill(child, SIGKILL);
+                    }
+                }
+            }
+        }
+        const auto elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+        if (failed) {
+            std::cerr << "A worker process failed" << std::endl;
+            return 1;
+        }
+        const auto ballSteps = static_cast<double>(world.entities().size()) * steps;
+        std::cout << "Wall time: " << elapsed << "s (" << (elapsed > 0.0 ? steps / elapsed : 0.0) << " steps/s, "
+            << (elapsed > 0.0 ? ballSteps / elapsed : 0.0) << " ball-steps/s)" << std::endl;
+        return 0;
+    }
+#endif
+}
+
+int main(int argc, char* argv[]) {
+    Integrator integrator = Integrator::SIMULATION_INTEGRATOR;
+    ThreadingMode threadingMode = ThreadingMode::SHARED_TREE;
 #ifdef USE_QUADTREES
-        DoQuadtreeCollisionDetection(world, 0.01f);
+    Broadphase broadphase = Broadphase::QUADTREE;
+#else
+    Broadphase broadphase = Broadphase::BRUTE_FORCE;
+#endif
+    unsigned threads = 1;
+    bool deterministic = false;
+    std::size_t ensemble = 1;
+    bool batched = false;
+    bool broadphaseChosen = false;
+    unsigned processes = 0;
+    int steps = 1000000;
+    float deltaTime = 0.01f;
+    ScenarioParameters scenario;
+    std::string scenarioPath, savePath, checkpointPath, restorePath, trajectoryPath;
+    RunOutput output;
+    float trajectoryError = 0.0f;
+    OutputPolicy outputPolicy = OutputPolicy::BLOCK;
+    QueryOptions query;
+    bool frameRange = false;
+
+    for (auto i = 1; i < argc; i++) {
+        if (std::strcmp(argv[i], "--integrator") == 0 && i + 1 < argc) {
+            if (!ParseIntegrator(argv[++i], integrator)) {
+                std::cerr << "Unknown integrator: " << argv[i] << std::endl;
+                return 1;
+            }
+        } else if (std::strcmp(argv[i], "--broadphase") == 0 && i + 1 < argc) {
+            if (!ParseBroadphase(argv[++i], broadphase)) {
+                std::cerr << "Unknown broadphase: " << argv[i] << std::endl;
+                return 1;
+            }
+            broadphaseChosen = true;
+        } else if (std::strcmp(argv[i], "--threads") == 0 && i + 1 < argc) {
+            const auto count = std::atoi(argv[++i]);
+            threads = count > 0 ? static_cast<unsigned>(count) : ThreadPool::hardware_threads();
+        } else if (std::strcmp(argv[i], "--threading") == 0 && i + 1 < argc) {
+            if (!ParseThreadingMode(argv[++i], threadingMode)) {
+                std::cerr << "Unknown threading mode: " << argv[i] << std::endl;
+                return 1;
+            }
+        } else if (std::strcmp(argv[i], "--deterministic") == 0) {
+            deterministic = true;
+        } else if (std::strcmp(argv[i], "--ensemble") == 0 && i + 1 < argc) {
+            const auto count = std::atoi(argv[++i]);
+            ensemble = static_cast<std::size_t>(std::max(count, 1));
+        } else if (std::strcmp(argv[i], "--batch") == 0) {
+            batched = true;
+        } else if (std::strcmp(argv[i], "--processes") == 0 && i + 1 < argc) {
+            processes = static_cast<unsigned>(std::max(std::atoi(argv[++i]), 1));
+        } else if (std::strcmp(argv[i], "--balls") == 0 && i + 1 < argc) {
+            scenario.balls = static_cast<std::size_t>(std::strtoull(argv[++i], nullptr, 10));
+        } else if ((std::strcmp(argv[i], "--radius") == 0 || std::strcmp(argv[i], "--mass") == 0) && i + 1 < argc) {
+            auto& distribution = argv[i][2] == 'r' ? scenario.radius : scenario.mass;
+            if (!ParseDistribution(argv[++i], distribution) || !distribution.positive()) {
+                std::cerr << "Bad distribution, every sample must be above zero: " << argv[i] << std::endl;
+                return 1;
+            }
+        } else if (std::strcmp(argv[i], "--speed") == 0 && i + 1 < argc) {
+            scenario.maxSpeed = std::max(static_cast<float>(std::atof(argv[++i])), 0.0f);
+        } else if (std::strcmp(argv[i], "--world") == 0 && i + 1 < argc) {
+            char* end = nullptr;
+            const auto width = std::strtof(argv[++i], &end);
+            const auto height = *end == 'x' ? std::strtof(end + 1, &end) : 0.0f;
+            if (width <= 0.0f || height <= 0.0f || *end != '\0') {
+                std::cerr << "Bad world size, expected WIDTHxHEIGHT: " << argv[i] << std::endl;
+                return 1;
+            }
+            scenario.bounds = { 0.0f, 0.0f, width, height };
+        } else if (std::strcmp(argv[i], "--gravity") == 0 && i + 1 < argc) {
+            scenario.gravity = static_cast<float>(std::atof(argv[++i]));
+        } else if (std::strcmp(argv[i], "--dt") == 0 && i + 1 < argc) {
+            deltaTime = static_cast<float>(std::atof(argv[++i]));
+            if (!(deltaTime > 0.0f)) {
+                std::cerr << "Bad time step: " << argv[i] << std::endl;
+                return 1;
+            }
+        } else if (std::strcmp(argv[i], "--steps") == 0 && i + 1 < argc) {
+            steps = std::max(std::atoi(argv[++i]), 1);
+        } else if (std::strcmp(argv[i], "--seed") == 0 && i + 1 < argc) {
+            scenario.seed = std::strtoull(argv[++i], nullptr, 10);
+        } else if (std::strcmp(argv[i], "--layout") == 0 && i + 1 < argc) {
+            if (!ParseScenarioLayout(argv[++i], scenario.layout)) {
+                std::cerr << "Unknown layout: " << argv[i] << std::endl;
+                return 1;
+            }
+        } else if (std::strcmp(argv[i], "--scenario") == 0 && i + 1 < argc) {
+            scenarioPath = argv[++i];
+        } else if (std::strcmp(argv[i], "--save-scenario") == 0 && i + 1 < argc) {
+            savePath = argv[++i];
+        } else if (std::strcmp(argv[i], "--checkpoint") == 0 && i + 1 < argc) {
+            checkpointPath = argv[++i];
+        } else if (std::strcmp(argv[i], "--checkpoint-every") == 0 && i + 1 < argc) {
+            output.checkpointInterval = std::strtoull(argv[++i], nullptr, 10);
+        } else if (std::strcmp(argv[i], "--trajectory") == 0 && i + 1 < argc) {
+            trajectoryPath = argv[++i];
+        } else if (std::strcmp(argv[i], "--record-every") == 0 && i + 1 < argc) {
+            output.recordInterval = std::max<std::uint64_t>(std::strtoull(argv[++i], nullptr, 10), 1);
+        } else if (std::strcmp(argv[i], "--trajectory-error") == 0 && i + 1 < argc) {
+            trajectoryError = std::max(static_cast<float>(std::atof(argv[++i])), 0.0f);
+        } else if (std::strcmp(argv[i], "--output-policy") == 0 && i + 1 < argc) {
+            if (!ParseOutputPolicy(argv[++i], outputPolicy)) {
+                std::cerr << "Unknown output policy: " << argv[i] << std::endl;
+                return 1;
+            }
+        } else if (std::strcmp(argv[i], "--restore") == 0 && i + 1 < argc) {
+            restorePath = argv[++i];
+        } else if (std::strcmp(argv[i], "--query") == 0 && i + 1 < argc) {
+            query.path = argv[++i];
+        } else if (std::strcmp(argv[i], "--ball") == 0 && i + 1 < argc) {
+            query.oneBall = true;
+            query.ball = static_cast<std::size_t>(std::strtoull(argv[++i], nullptr, 10));
+        } else if (std::strcmp(argv[i], "--frame") == 0 && i + 1 < argc) {
+            query.first = query.last = std::strtoull(argv[++i], nullptr, 10);
+        } else if (std::strcmp(argv[i], "--frames") == 0 && i + 1 < argc) {
+            char* end = nullptr;
+            query.first = std::strtoull(argv[++i], &end, 10);
+            if (*end != ':') {
+                std::cerr << "Bad frame range, expected FIRST:LAST: " << argv[i] << std::endl;
+                return 1;
+            }
+            query.last = std::strtoull(end + 1, nullptr, 10);
+            frameRange = true;
+        } else if (std::strcmp(argv[i], "--columns") == 0 && i + 1 < argc) {
+            if (!ParseColumns(argv[++i], query.columns)) {
+                std::cerr << "Unknown columns: " << argv[i] << std::endl;
+                return 1;
+            }
+        } else {
+            std::cerr << "Usage: " << argv[0] << " [--balls count] [--radius dist] [--mass dist] [--speed max]"
+                " [--world WIDTHxHEIGHT] [--gravity g] [--seed n]"
+                " [--layout uniform|clustered|split-lines|crystal|bimodal|giant] [--scenario file] [--save-scenario file]"
+                " [--checkpoint file [--checkpoint-every steps]] [--restore file] [--trajectory file [--record-every steps] [--trajectory-error bound]]"
+                " [--output-policy drop|block]"
+                " [--query trajectory [--ball index [--frames first:last] | --frame index] [--columns positions|velocities|all]]"
+                " [--dt seconds] [--steps count]"
+                " [--broadphase quadtree|brute] [--integrator name] [--threads count]"
+                " [--threading shared|domain|stealing] [--deterministic] [--ensemble worlds [--batch]]"
+                " [--processes count]" << std::endl;
+            std::cerr << "A dist is a constant, uniform:min:max or normal:mean:deviation" << std::endl;
+            return 1;
+        }
+    }
+
+    if (!query.path.empty()) {
+        // a range of frames is only answered for one ball; every ball is read one frame at a time
+        if (frameRange && !query.oneBall) {
+            std::cerr << "--frames needs --ball" << std::endl;
+            return 1;
+        }
+        return RunQuery(query);
+    }
+
+    ScenarioFile description;
+    const auto loadStart = std::chrono::steady_clock::now();
+    if (!restorePath.empty()) {
+        // the world comes from the checkpoint instead
+    } else if (!scenarioPath.empty()) {
+        std::string error;
+        if (!ReadScenarioFile(scenarioPath, description, error)) {
+            std::cerr << "Couldn't read scenario: " << error << std::endl;
+            return 1;
+        }
+        std::cout << "Scenario: " << scenarioPath << ", " << description.ball_count() << " balls, world "
+            << description.bounds.w << "x" << description.bounds.h << ", gravity " << description.gravity
+            << ", seed " << description.seed << std::endl;
+    } else {
+        description = DescribeScenario(scenario);
+        std::cout << "Scenario: " << scenario.balls << " balls, radius " << scenario.radius.describe()
+            << ", mass " << scenario.mass.describe() << ", speed " << scenario.maxSpeed << ", world "
+            << scenario.bounds.w << "x" << scenario.bounds.h << ", gravity " << scenario.gravity
+            << ", seed " << scenario.seed << ", " << ScenarioLayoutName(scenario.layout) << " layout" << std::endl;
+    }
+    if (!savePath.empty()) {
+        // .txt gets the text form, anything else the binary one
+        const auto binary = savePath.size() < 4 || savePath.compare(savePath.size() - 4, 4, ".txt") != 0;
+        if (!WriteScenarioFile(savePath, description, binary)) {
+            std::cerr << "Couldn't write scenario to " << savePath << std::endl;
+            return 1;
+        }
+    }
+
+    // ensemble members differ only in their seed
+    const auto setup = [&](World& world, std::size_t member) {
+        world.set_integrator(integrator);
+        world.set_threading_mode(threadingMode);
+        world.set_deterministic(deterministic);
+        if (member == 0) {
+            LoadScenario(world, description);
+        } else {
+            auto seeded = description;
+            seeded.seed += member;
+            LoadScenario(world, seeded);
+        }
+    };
+
+    // a batch tests every pair of its lanes at once, so no other broadphase can be honoured
+    if (batched && ensemble > 1) {
+        if (broadphaseChosen && broadphase != Broadphase::BRUTE_FORCE) {
+            std::cerr << "Batched ensembles only run the brute force broadphase" << std::endl;
+            return 1;
+        }
+        broadphase = Broadphase::BRUTE_FORCE;
+    }
+
+    std::cout << "Steps: " << steps << " of " << deltaTime << "s, " << BroadphaseName(broadphase)
+        << " broadphase" << std::endl;
+
+    if ((!checkpointPath.empty() || !restorePath.empty() || !trajectoryPath.empty()) && (processes > 0 || ensemble > 1)) {
+        std::cerr << "Checkpoints and trajectories only work for single world runs" << std::endl;
+        return 1;
+    }
+
+    if (processes > 0) {
+#ifdef HAVE_SHARED_MEMORY_TRANSPORT
+        World world;
+        setup(world, 0);
+        return RunProcesses(world, processes, steps, deltaTime);
 #else
-        DoSimpleCollisionDetection(world, 0.01f);
+        std::cerr << "Multi-process runs need POSIX shared memory" << std::endl;
+        return 1;
 #endif
     }
 
+    if (ensemble > 1) {
+        return RunEnsemble(ensemble, threads, batched, steps, deltaTime, BroadphaseStep(broadphase), setup);
+    }
+
+    World world;
+    world.set_threads(threads);
+    std::uint64_t firstStep = 0;
+    if (!restorePath.empty()) {
+        // the checkpoint brings its own integrator and determinism, everything else is ours
+        std::string error;
+        world.set_threading_mode(threadingMode);
+        if (!RestoreCheckpoint(restorePath, world, firstStep, error)) {
+            std::cerr << "Couldn't restore checkpoint: " << error << std::endl;
+            return 1;
+        }
+        std::cout << "Restored " << world.entities().size() << " balls at step " << firstStep << " from "
+            << restorePath << std::endl;
+        // --steps counts from the start of the run, so there has to be something left after the checkpoint
+        if (static_cast<std::uint64_t>(steps) <= firstStep) {
+            std::cerr << "--steps " << steps << " doesn't go past the checkpoint at step " << firstStep << std::endl;
+            return 1;
+        }
+        steps = static_cast<int>(static_cast<std::uint64_t>(steps) - firstStep);
+    } else {
+        setup(world, 0);
+    }
+    std::cout << "Load time: " << std::chrono::duration<double>(std::chrono::steady_clock::now() - loadStart).count()
+        << "s" << std::endl;
+
+    std::unique_ptr<Checkpointer> checkpointer;
+    if (!checkpointPath.empty()) {
+        checkpointer = std::make_unique<Checkpointer>(checkpointPath, outputPolicy);
+        output.checkpointer = checkpointer.get();
+        if (output.checkpointInterval == 0) {
+            output.checkpointInterval = static_cast<std::uint64_t>(std::max(steps / 10, 1));
+        }
+    }
+    std::unique_ptr<TrajectoryWriter> trajectory;
+    if (!trajectoryPath.empty()) {
+        trajectory = TrajectoryWriter::create(trajectoryPath, world, deltaTime * static_cast<float>(output.recordInterval),
+            trajectoryError, outputPolicy);
+        if (trajectory == nullptr) {
+            std::cerr << "Couldn't create trajectory file " << trajectoryPath << std::endl;
+            return 1;
+        }
+        output.trajectory = trajectory.get();
+    }
+
+    const auto result = Run(world, steps, deltaTime, BroadphaseStep(broadphase), firstStep, output);
+    const auto elapsed = result.seconds;
+    const auto ballSteps = static_cast<double>(world.entities().size()) * steps;
+
+    std::cout << "Wall time: " << elapsed << "s (" << (elapsed > 0.0 ? steps / elapsed : 0.0) << " steps/s, "
+        << (elapsed > 0.0 ? ballSteps / elapsed : 0.0) << " ball-steps/s, "
+        << (steps > 0 ? elapsed * 1000.0 / steps : 0.0) << "ms/step)" << std::endl;
+    std::cout << "Integrator: " << IntegratorName(world.integrator()) << std::endl;
+    std::cout << "Energy drift: " << result.drift << "/s ("
+        << result.relativeDrift * 100.0 << "%/s)" << std::endl;
+    std::cout << "Substeps: " << result.substeps << " (" << (steps > 0 ? static_cast<double>(result.substeps) / steps : 0.0)
+        << " per step, min dt " << result.minSubstepDeltaTime << ")" << std::endl;
+    std::cout << "State hash: " << std::hex << HashBalls(world.entities()) << std::dec << " after step "
+        << firstStep + static_cast<std::uint64_t>(steps) << std::endl;
+
+    if (trajectory != nullptr) {
+        const auto ok = trajectory->close();
+        const auto& stats = trajectory->stats();
+        constexpr auto MiB = 1024.0 * 1024.0;
+        std::cout << "Trajectory: " << stats.frames << " frames in " << stats.chunks << " chunks to " << trajectoryPath
+            << ", " << static_cast<double>(stats.writtenBytes) / MiB << "MiB of " << static_cast<double>(stats.rawBytes) / MiB
+            << "MiB raw (" << (stats.writtenBytes > 0 ? static_cast<double>(stats.rawBytes) / static_cast<double>(stats.writtenBytes) : 0.0)
+            << "x), encode " << stats.encodeSeconds << "s" << std::endl;
+        std::cout << "Trajectory queue: " << OutputPolicyName(outputPolicy) << ", " << stats.output.dropped
+            << " frames dropped, max depth " << stats.output.maxDepth << ", blocked " << stats.output.blockedSeconds
+            << "s" << std::endl;
+        if (trajectoryError > 0.0f) {
+            std::cout << "Quantisation error: " << stats.maxPositionError << " position, " << stats.maxVelocityError
+                << " velocity (bound " << trajectoryError << "), " << stats.losslessColumns
+                << " chunk columns stored losslessly" << std::endl;
+        }
+        if (!ok) {
+            std::cerr << "Writing the trajectory failed" << std::endl;
+            return 1;
+        }
+    }
+
+    if (checkpointer != nullptr) {
+        const auto ok = checkpointer->wait();
+        const auto& stats = checkpointer->stats();
+        std::cout << "Checkpoints: " << stats.checkpoints << " to " << checkpointPath << ", pause "
+            << (stats.checkpoints > 0 ? stats.pauseSeconds * 1000.0 / stats.checkpoints : 0.0) << "ms mean "
+            << stats.maxPauseSeconds * 1000.0 << "ms max, write " << stats.writeSeconds << "s for "
+            << static_cast<double>(stats.bytes) / (1024.0 * 1024.0) << "MiB, " << stats.output.dropped << " dropped"
+            << std::endl;
+        if (!ok) {
+            std::cerr << "Writing a checkpoint failed" << std::endl;
+            return 1;
+        }
+    }
+
+    if (world.deterministic()) {
+        const auto& ordering = world.contact_ordering();
+        std::cout << "Deterministic ordering: " << ordering.orderingSeconds << "s ("
+            << (elapsed > 0.0 ? 100.0 * ordering.orderingSeconds / elapsed : 0.0) << "% of step time), "
+            << (ordering.steps > 0 ? static_cast<double>(ordering.batches) / ordering.steps : 0.0)
+            << " batches per step" << std::endl;
+    }
+
+    if (const auto* scheduler = std::as_const(world).scheduler()) {
+        const auto stats = scheduler->stats();
+        for (std::size_t i = 0; i < stats.size(); i++) {
+            const auto total = stats[i].busySeconds + stats[i].idleSeconds;
+            std::cout << "Worker " << i << ": busy " << stats[i].busySeconds << "s, idle " << stats[i].idleSeconds
+                << "s (" << (total > 0.0 ? 100.0 * stats[i].busySeconds / total : 0.0) << "% busy), "
+                << stats[i].tasks << " tasks, " << stats[i].steals << " stolen, parked " << stats[i].parks << " times" << std::endl;
+        }
+    }
+
     return 0;
 }
@@ -0,0 +1,62 @@
+#include "mappedfile.hpp"
+
+#include <cstdio>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define HAVE_MMAP
+#endif
+
+using namespace BallSimulator;
+
+std::unique_ptr<MappedFile> MappedFile::open(const std::string& path) {
+    std::unique_ptr<MappedFile> file(new MappedFile());
+#ifdef HAVE_MMAP
+    const auto fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        return nullptr;
+    }
+    struct stat status;
+    if (fstat(fd, &status) != 0) {
+        close(fd);
+        return nullptr;
+    }
+    file->_size = static_cast<std::size_t>(status.st_size);
+    if (file->_size > 0) {
+        auto* memory = mmap(nullptr, file->_size, PROT_READ, MAP_SHARED, fd, 0);
+        if (memory == MAP_FAILED) {
+            close(fd);
+            return nullptr;
+        }
+        file->_data = static_cast<const std::byte*>(memory);
+    }
+    close(fd);
+#else
+    auto* handle = std::fopen(path.c_str(), "rb");
+    if (handle == nullptr) {
+        return nullptr;
+    }
+    std::fseek(handle, 0, SEEK_END);
+    file->_buffer.resize(static_cast<std::size_t>(std::ftell(handle)));
+    std::rewind(handle);
+    const auto read = std::fread(file->_buffer.data(), 1, file->_buffer.size(), handle);
+    std::fclose(handle);
+    if (read != file->_buffer.size()) {
+        return nullptr;
+    }
+    file->_data = file->_buffer.data();
+    file->_size = file->_buffer.size();
+#endif
+    return file;
+}
+
+MappedFile::~MappedFile() {
+#ifdef HAVE_MMAP
+    if (_data != nullptr) {
+        munmap(const_cast<std::byte*>(_data), _size);
+    }
+#endif
+}
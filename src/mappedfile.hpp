@@ -0,0 +1,31 @@
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <span>
+#include <string>
+#include <vector>
+
+namespace BallSimulator {
+    // A whole file mapped read-only. Pages are only read in as they are touched, so opening
+    // a file far bigger than memory is cheap. Without mmap the file is read into memory instead.
+    class MappedFile {
+        const std::byte* _data = nullptr;
+        std::size_t _size = 0;
+        std::vector<std::byte> _buffer;
+
+        MappedFile() = default;
+
+    public:
+        ~MappedFile();
+
+        MappedFile(const MappedFile&) = delete;
+        MappedFile& operator =(const MappedFile&) = delete;
+
+        // null if the file couldn't be opened or mapped
+        static std::unique_ptr<MappedFile> open(const std::string& path);
+
+        inline std::span<const std::byte> bytes() const { return { _data, _size }; }
+        inline std::size_t size() const { return _size; }
+    };
+}
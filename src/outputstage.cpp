@@ -0,0 +1,21 @@
+#include "outputstage.hpp"
+
+using namespace BallSimulator;
+
+const char* BallSimulator::OutputPolicyName(OutputPolicy policy) {
+    switch (policy) {
+        case OutputPolicy::DROP:  return "drop";
+        case OutputPolicy::BLOCK: return "block";
+    }
+    return "unknown";
+}
+
+bool BallSimulator::ParseOutputPolicy(std::string_view name, OutputPolicy& policy) {
+    for (auto candidate : { OutputPolicy::DROP, OutputPolicy::BLOCK }) {
+        if (name == OutputPolicyName(candidate)) {
+            policy = candidate;
+            return true;
+        }
+    }
+    return false;
+}
@@ -0,0 +1,183 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+namespace BallSimulator {
+    // what to do with a new item when the writer is still busy with all the earlier ones
+    enum class OutputPolicy { DROP, BLOCK };
+
+    const char* OutputPolicyName(OutputPolicy policy);
+    bool ParseOutputPolicy(std::string_view name, OutputPolicy& policy);
+
+    struct OutputStats {
+        std::uint64_t published = 0;
+        std::uint64_t dropped = 0;
+        std::size_t maxDepth = 0;           // most items ever waiting at once, counted on publish
+        double blockedSeconds = 0.0;        // producer time spent waiting for a free slot
+    };
+
+    // Bounded lock-free single-producer/single-consumer ring of slots that are allocated once
+    // and reused, so buffers inside them keep their capacity from one lap to the next. Head and
+    // tail count slots ever consumed and published; the two signal counters exist only for
+    // the side that runs out of work to sleep on.
+    template <typename T>
+    class SpscRing {
+        std::vector<T> _slots;
+        alignas(64) std::atomic<std::uint64_t> _head{ 0 };
+        alignas(64) std::atomic<std::uint64_t> _tail{ 0 };
+        alignas(64) std::atomic<std::uint32_t> _published{ 0 };
+        alignas(64) std::atomic<std::uint32_t> _consumed{ 0 };
+
+    public:
+        explicit SpscRing(std::size_t capacity) : _slots(std::max<std::size_t>(capacity, 1)) {}
+
+        inline std::size_t capacity() const { return _slots.size(); }
+        inline std::size_t depth() const {
+            return static_cast<std::size_t>(_tail.load(std::memory_order_acquire) - _head.load(std::memory_order_acquire));
+        }
+
+        // producer side: the next free slot, or null if the ring is full
+        inline T* back() {
+            const auto tail = _tail.load(std::memory_order_relaxed);
+            if (tail - _head.load(std::memory_order_acquire) >= _slots.size()) {
+                return nullptr;
+            }
+            return &_slots[tail % _slots.size()];
+        }
+
+        inline void push() {
+            _tail.store(_tail.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+            _published.fetch_add(1, std::memory_order_release);
+            _published.notify_one();
+        }
+
+        // consumer side: the oldest published slot, or null if there is none
+        inline T* front() {
+            const auto head = _head.load(std::memory_order_relaxed);
+            if (_tail.load(std::memory_order_acquire) == head) {
+                return nullptr;
+            }
+            return &_slots[head % _slots.size()];
+        }
+
+        inline void pop() {
+            _head.store(_head.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+            _consumed.fetch_add(1, std::memory_order_release);
+            _consumed.notify_all();
+        }
+
+        // take a signal value, check the ring, then wait on the value if there was nothing to do
+        inline std::uint32_t published_signal() const { return _published.load(std::memory_order_acquire); }
+        inline std::uint32_t consumed_signal() const { return _consumed.load(std::memory_order_acquire); }
+        inline void wait_published(std::uint32_t signal) const { _published.wait(signal, std::memory_order_acquire); }
+        inline void wait_consumed(std::uint32_t signal) const { _consumed.wait(signal, std::memory_order_acquire); }
+        // wakes a consumer waiting for work without publishing anything
+        inline void interrupt() {
+            _published.fetch_add(1, std::memory_order_release);
+            _published.notify_one();
+        }
+    };
+
+    // A writer thread fed through an SpscRing. The producer fills the slot from acquire() and
+    // hands it over with publish(), which never takes a lock, and consume runs on the writer
+    // thread for each slot in order. When every slot is taken, DROP makes acquire() return
+    // null straight away and BLOCK makes it wait for the writer.
+    template <typename T>
+    class OutputStage {
+        SpscRing<T> _ring;
+        OutputPolicy _policy;
+        std::function<void(T&)> _consume;
+        std::atomic<bool> _stopping{ false };
+        OutputStats _stats;
+        std::thread _thread;
+
+        void run() {
+            for (;;) {
+                const auto signal = _ring.published_signal();
+                if (auto* item = _ring.front()) {
+                    _consume(*item);
+                    _ring.pop();
+                    continue;
+                }
+                if (_stopping.load(std::memory_order_acquire)) {
+                    return;
+                }
+                _ring.wait_published(signal);
+            }
+        }
+
+    public:
+        OutputStage(std::size_t capacity, OutputPolicy policy, std::function<void(T&)> consume) :
+            _ring(capacity), _policy(policy), _consume(std::move(consume)), _thread(&OutputStage::run, this) {}
+
+        ~OutputStage() {
+            stop();
+        }
+
+        OutputStage(const OutputStage&) = delete;
+        OutputStage& operator =(const OutputStage&) = delete;
+
+        // producer side: a slot to fill, or null if this item is to be dropped
+        T* acquire() {
+            if (auto* slot = _ring.back()) {
+                return slot;
+            }
+            if (_policy == OutputPolicy::DROP) {
+                _stats.dropped++;
+                return nullptr;
+            }
+
+            const auto start = std::chrono::steady_clock::now();
+            T* slot = nullptr;
+            for (;;) {
+                const auto signal = _ring.consumed_signal();
+                if ((slot = _ring.back()) != nullptr) {
+                    break;
+                }
+                _ring.wait_consumed(signal);
+            }
+            _stats.blockedSeconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+            return slot;
+        }
+
+        void publish() {
+            _ring.push();
+            _stats.published++;
+            _stats.maxDepth = std::max(_stats.maxDepth, _ring.depth());
+        }
+
+        // waits until the writer has consumed everything published so far
+        void drain() {
+            for (;;) {
+                const auto signal = _ring.consumed_signal();
+                if (_ring.depth() == 0) {
+                    return;
+                }
+                _ring.wait_consumed(signal);
+            }
+        }
+
+        // drains and stops the writer thread; nothing may be published afterwards
+        void stop() {
+            if (!_thread.joinable()) {
+                return;
+            }
+            drain();
+            _stopping.store(true, std::memory_order_release);
+            _ring.interrupt();
+            _thread.join();
+        }
+
+        inline std::size_t depth() const { return _ring.depth(); }
+        inline OutputPolicy policy() const { return _policy; }
+        inline const OutputStats& stats() const { return _stats; }
+    };
+}
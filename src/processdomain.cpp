@@ -0,0 +1,175 @@
+#include "processdomain.hpp"
+#include "integrator.hpp"
+#include "config.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <iterator>
+
+using namespace BallSimulator;
+
+namespace {
+    // a frame to a neighbour: migrant and halo counts, then the migrants, then the halo
+    struct FrameHeader {
+        std::uint32_t migrants;
+        std::uint32_t halo;
+    };
+
+    enum Side { LEFT, RIGHT };
+}
+
+ProcessDomain::ProcessDomain(Transport& transport, const World& world) :
+    _transport(transport) {
+    const auto& bounds = world.bounds();
+    const auto rank = transport.rank();
+    const auto ranks = transport.size();
+    const auto width = bounds.w / static_cast<float>(ranks);
+    _x1 = bounds.x + width * static_cast<float>(rank);
+    _x2 = rank + 1 == ranks ? bounds.x + bounds.w : bounds.x + width * static_cast<float>(rank + 1);
+
+    _world.resize(bounds);
+    _world.set_gravity(world.gravity());
+    _world.set_integrator(world.integrator());
+
+    // every rank starts from the same full copy, so they all agree on the reach and the split
+    float maxRadius = 0.0f;
+    for (const auto& ball : world.entities()) {
+        maxRadius = std::max(maxRadius, ball.radius());
+        const auto x = ball.get_position().x;
+        if ((rank == 0 || x >= _x1) && (rank + 1 == ranks || x < _x2)) {
+            _world.add(ball);
+        }
+    }
+    _reach = 2.0f * maxRadius;
+}
+
+bool ProcessDomain::exchange() {
+    const auto rank = _transport.rank();
+    const auto ranks = _transport.size();
+    auto& balls = _world.entities();
+    _halo.clear();
+
+    for (auto side : { LEFT, RIGHT }) {
+        if ((side == LEFT && rank == 0) || (side == RIGHT && rank + 1 == ranks)) {
+            continue;
+        }
+        const auto leaving = [&](const Ball& ball) {
+            const auto x = ball.get_position().x;
+            return side == LEFT ? x < _x1 : x >= _x2;
+        };
+        const auto near_edge = [&](const Ball& ball) {
+            const auto x = ball.get_position().x;
+            return side == LEFT ? x < _x1 + _reach : x >= _x2 - _reach;
+        };
+
+        _outgoing.clear();
+        std::copy_if(std::begin(balls), std::end(balls), std::back_inserter(_outgoing), leaving);
+        balls.erase(std::remove_if(std::begin(balls), std::end(balls), leaving), std::end(balls));
+
+        const FrameHeader header{ static_cast<std::uint32_t>(_outgoing.size()),
+            static_cast<std::uint32_t>(std::count_if(std::begin(balls), std::end(balls), near_edge)) };
+        _message.resize(sizeof(header) + (header.migrants + header.halo) * sizeof(Ball));
+        auto* out = _message.data();
+        std::memcpy(out, &header, sizeof(header));
+        out += sizeof(header);
+        std::memcpy(out, _outgoing.data(), _outgoing.size() * sizeof(Ball));
+        out += _outgoing.size() * sizeof(Ball);
+        for (const auto& ball : balls) {
+            if (near_edge(ball)) {
+                std::memcpy(out, &ball, sizeof(Ball));
+                out += sizeof(Ball);
+            }
+        }
+
+        if (!_transport.send(side == LEFT ? rank - 1 : rank + 1, _message)) {
+            return false;
+        }
+
+        // balls just handed over are still right next to our edge, so keep colliding against them
+        _halo.insert(std::end(_halo), std::begin(_outgoing), std::end(_outgoing));
+        _stats.migrated += header.migrants;
+        _stats.halo += header.halo;
+    }
+
+    _transport.barrier();
+
+    for (auto side : { LEFT, RIGHT }) {
+        if ((side == LEFT && rank == 0) || (side == RIGHT && rank + 1 == ranks)) {
+            continue;
+        }
+        _transport.receive(side == LEFT ? rank - 1 : rank + 1, _message);
+
+        FrameHeader header;
+        std::memcpy(&header, _message.data(), sizeof(header));
+        const auto* in = _message.data() + sizeof(header);
+        for (std::uint32_t i = 0; i < header.migrants + header.halo; i++, in += sizeof(Ball)) {
+            Ball ball(0.0f, 0.0f);
+            std::memcpy(&ball, in, sizeof(Ball));
+            if (i < header.migrants) {
+                _world.add(ball);
+            } else {
+                _halo.push_back(ball);
+            }
+        }
+    }
+    return true;
+}
+
+void ProcessDomain::collide() {
+    auto& balls = _world.entities();
+    const auto& bounds = _world.bounds();
+
+    _tree.reset({ _x1 - _reach, bounds.y, _x2 - _x1 + 2.0f * _reach, bounds.h });
+    for (auto& ball : balls) {
+        _tree.insert(std::ref(ball));
+    }
+
+    // halo pairs go first, while our balls still hold the values the neighbour was sent, so
+    // both ranks work out the same response and each applies its own half of it
+    for (auto& halo : _halo) {
+        _tree.retrieve(_candidates, std::ref(halo));
+        for (auto& ball : _candidates) {
+            ball.get().collide_one_sided(halo);
+        }
+        _candidates.clear();
+    }
+
+    // the tree only holds balls we own, so every other pair gets the full response
+    for (auto& ballA : balls) {
+        _tree.retrieve(_candidates, std::ref(ballA));
+        for (auto& ballB : _candidates) {
+            if (&ballB.get() != &ballA) {
+                ballA.collide(ballB);
+            }
+        }
+        _candidates.clear();
+    }
+
+    for (auto& ball : balls) {
+        ball.apply_world_boundary(_world);
+    }
+}
+
+bool ProcessDomain::step(float deltaTime) {
+    const auto start = std::chrono::steady_clock::now();
+    const auto before = _transport.stats();
+
+    deltaTime *= SIMULATION_TIMESCALE;
+    Integrate(_world, deltaTime);
+    if (!exchange()) {
+        return false;
+    }
+    collide();
+
+    const auto& after = _transport.stats();
+    const auto elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    const auto wait = after.waitSeconds - before.waitSeconds;
+    _stats.steps++;
+    _stats.computeSeconds += elapsed - wait;
+    _stats.waitSeconds += wait;
+    _stats.messages += after.messages - before.messages;
+    _stats.bytes += after.bytes - before.bytes;
+    _stats.owned = _world.entities().size();
+    return true;
+}
@@ -0,0 +1,50 @@
+#pragma once
+
+#include "world.hpp"
+#include "transport.hpp"
+#include <cstdint>
+#include <vector>
+
+namespace BallSimulator {
+    struct ProcessStepStats {
+        std::uint64_t steps = 0;
+        double computeSeconds = 0.0;    // integration, packing and collisions
+        double waitSeconds = 0.0;       // blocked on the transport
+        std::uint64_t messages = 0;
+        std::uint64_t bytes = 0;
+        std::uint64_t halo = 0;         // halo copies sent
+        std::uint64_t migrated = 0;     // balls handed to a neighbour
+        std::uint64_t owned = 0;        // balls owned after the last step
+    };
+
+    // One rank of a multi-process run. The world is cut into vertical strips, one per rank,
+    // and every step each rank moves its own balls, hands the ones that crossed an edge to
+    // that neighbour, swaps read-only halo copies of the balls near each shared edge and then
+    // resolves collisions and walls for the balls it owns. Steps are fixed, not substepped.
+    class ProcessDomain {
+        Transport& _transport;
+        World _world;
+        float _x1, _x2;
+        float _reach;
+        std::vector<Ball> _halo;
+        std::vector<Ball> _outgoing;
+        CollisionQuadtree _tree;
+        std::vector<CollisionQuadtree::RefT> _candidates;
+        std::vector<std::byte> _message;
+        ProcessStepStats _stats;
+
+        bool exchange();
+        void collide();
+
+    public:
+        // keeps only the balls of world that lie in this rank's strip
+        ProcessDomain(Transport& transport, const World& world);
+
+        // false if a neighbour couldn't be sent its share
+        bool step(float deltaTime);
+
+        inline const World& world() const { return _world; }
+        inline const ProcessStepStats& stats() const { return _stats; }
+        inline void reset_stats() { _stats = {}; }
+    };
+}
@@ -2,9 +2,92 @@
 
 #include "rectangle.hpp"
 #include <vector>
+#include <algorithm>
 #include <array>
+#include <cstddef>
 #include <functional>
 #include <memory>
+#include <span>
+#include <utility>
+
+// Hands out the memory of one build of a quadtree and takes all of it back at once when the
+// tree is cleared. Blocks are kept from build to build and a new one is as big as all the
+// others together, so once the tree has had room for its biggest build, building it again
+// doesn't go to the heap at all.
+class QuadtreeArena {
+    struct Block {
+        std::unique_ptr<std::byte[]> data;
+        std::size_t size;
+    };
+
+    static constexpr std::size_t MinBlockBytes = 16 << 10;
+    static constexpr std::size_t Alignment = alignof(std::max_align_t);
+
+    std::vector<Block> _blocks;
+    std::size_t _block = 0;     // the next block to move on to
+    std::byte* _next = nullptr;
+    std::byte* _end = nullptr;
+    std::size_t _capacity = 0;
+
+    void* next_block(std::size_t bytes) {
+        for (; _block < _blocks.size(); _block++) {
+            auto& block = _blocks[_block];
+            if (bytes <= block.size) {
+                _next = block.data.get() + bytes;
+                _end = block.data.get() + block.size;
+                _block++;
+                return block.data.get();
+            }
+        }
+
+        const auto size = std::max({ bytes, _capacity, MinBlockBytes });
+        _blocks.push_back({ std::make_unique_for_overwrite<std::byte[]>(size), size });
+        _capacity += size;
+        return next_block(bytes);
+    }
+
+public:
+    QuadtreeArena() = default;
+    QuadtreeArena(const QuadtreeArena&) = delete;
+    QuadtreeArena& operator =(const QuadtreeArena&) = delete;
+
+    inline void* allocate(std::size_t bytes) {
+        bytes = (bytes + Alignment - 1) & ~(Alignment - 1);
+        if (bytes <= static_cast<std::size_t>(_end - _next)) {
+            auto* memory = _next;
+            _next += bytes;
+            return memory;
+        }
+        return next_block(bytes);
+    }
+
+    // takes back everything handed out so far, keeping the blocks
+    inline void reset() {
+        _block = 0;
+        _next = _end = nullptr;
+    }
+
+    inline std::size_t capacity() const { return _capacity; }
+};
+
+// lets a tree's vectors take their memory from its arena. giving memory back does nothing,
+// since the arena takes all of it back when the tree is cleared
+template <typename T>
+struct QuadtreeAllocator {
+    typedef T value_type;
+
+    QuadtreeArena* arena;
+
+    QuadtreeAllocator(QuadtreeArena* arena) noexcept : arena(arena) {}
+    template <typename U>
+    QuadtreeAllocator(const QuadtreeAllocator<U>& other) noexcept : arena(other.arena) {}
+
+    inline T* allocate(std::size_t count) { return static_cast<T*>(arena->allocate(count * sizeof(T))); }
+    inline void deallocate(T*, std::size_t) noexcept {}
+
+    template <typename U>
+    inline bool operator ==(const QuadtreeAllocator<U>& other) const noexcept { return arena == other.arena; }
+};
 
 template <typename T, int MaxObjects, int MaxLevels>
 class Quadtree {
@@ -12,14 +95,15 @@ public:
     typedef std::reference_wrapper<T> RefT;
 
 private:
+    typedef std::vector<RefT, QuadtreeAllocator<RefT>> Items;
+
     class Quad {
         std::array<Quadtree, 4> _nodes;
 
     public:
-        constexpr Quad(
-            Quadtree&& new_top_left, Quadtree&& new_top_right, Quadtree&& new_bottom_left, Quadtree&& new_bottom_right
-        ) : _nodes{
-            std::move(new_top_left), std::move(new_top_right), std::move(new_bottom_left), std::move(new_bottom_right)
+        Quad(QuadtreeArena& arena, int level, const std::array<Rectangle<float>, 4>& bounds) : _nodes{
+            Quadtree(arena, level, bounds[0]), Quadtree(arena, level, bounds[1]),
+            Quadtree(arena, level, bounds[2]), Quadtree(arena, level, bounds[3])
         } {}
 
         inline constexpr const Quadtree& top_left() const     { return _nodes[0]; }
@@ -37,24 +121,41 @@ private:
         inline constexpr iterator end()   { return std::end(_nodes); }
     };
 
-    std::vector<RefT> _objects, _stuck;
+    // the root owns the arena that every node of the tree, and every node's items, live in.
+    // nodes hold nothing but arena memory, so they are never destroyed, just forgotten when
+    // the arena is reset
+    std::unique_ptr<QuadtreeArena> _ownArena;
+    QuadtreeArena* _arena;
+    Items _objects, _stuck;
     int _level;
     Rectangle<float> _bounds;
-    std::unique_ptr<Quad> _nodes;
+    Quad* _nodes = nullptr;     // made in the arena by the first split of this build
 
-    void split() {
-        auto subWidth = _bounds.w / 2.0f;
-        auto subHeight = _bounds.h / 2.0f;
-        auto x = _bounds.x;
-        auto y = _bounds.y;
+    Quadtree(QuadtreeArena& arena, int level, const Rectangle<float>& bounds) :
+        _arena(&arena), _objects(&arena), _stuck(&arena), _level(level), _bounds(bounds) {
+    }
+
+    static std::array<Rectangle<float>, 4> quadrants(const Rectangle<float>& bounds) {
+        auto subWidth = bounds.w / 2.0f;
+        auto subHeight = bounds.h / 2.0f;
+        auto x = bounds.x;
+        auto y = bounds.y;
+        return { {
+            { x + subWidth, y, subWidth, subHeight },
+            { x, y, subWidth, subHeight },
+            { x, y + subHeight, subWidth, subHeight },
+            { x + subWidth, y + subHeight, subWidth, subHeight }
+        } };
+    }
 
-        auto nextLevel = _level + 1;
-        _nodes = std::make_unique<Quad>(
-            Quadtree(nextLevel, { x + subWidth, y, subWidth, subHeight }),
-            Quadtree(nextLevel, { x, y, subWidth, subHeight }),
-            Quadtree(nextLevel, { x, y + subHeight, subWidth, subHeight }),
-            Quadtree(nextLevel, { x + subWidth, y + subHeight, subWidth, subHeight })
-        );
+    void split() {
+        auto* memory = _arena->allocate(sizeof(Quad));
+        _nodes = std::construct_at(static_cast<Quad*>(memory), *_arena, _level + 1, quadrants(_bounds));
+        // a child fills to one past MaxObjects before it splits in turn, so that much room
+        // up front saves it growing its way there
+        for (auto& node : *_nodes) {
+            node._objects.reserve(MaxObjects + 1);
+        }
     }
 
     int get_index(const RefT object) const {
@@ -88,19 +189,48 @@ private:
     }
 
 public:
-    constexpr Quadtree(): _level(0), _bounds(Rectangle<float>::zero()) {}
-    constexpr Quadtree(int level, const Rectangle<float>& bounds) :
+    Quadtree() : Quadtree(0, Rectangle<float>::zero()) {}
+    Quadtree(int level, const Rectangle<float>& bounds) :
+        _ownArena(std::make_unique<QuadtreeArena>()),
+        _arena(_ownArena.get()),
+        _objects(_arena),
+        _stuck(_arena),
         _level(level),
         _bounds(bounds) {
     }
 
-    constexpr const std::vector<RefT>& objects() const { return _objects; }
+    Quadtree(Quadtree&& other) noexcept :
+        _ownArena(std::move(other._ownArena)),
+        _arena(other._arena),
+        _objects(std::move(other._objects)),
+        _stuck(std::move(other._stuck)),
+        _level(other._level),
+        _bounds(other._bounds),
+        _nodes(std::exchange(other._nodes, nullptr)) {
+    }
+
+    Quadtree(const Quadtree&) = delete;
+    Quadtree& operator =(const Quadtree&) = delete;
+    Quadtree& operator =(Quadtree&&) = delete;
+
+    constexpr std::span<const RefT> objects() const { return _objects; }
+    // objects that fit a child quadrant by midpoint but overhang its bounds
+    constexpr std::span<const RefT> stuck() const { return _stuck; }
+    constexpr int level() const { return _level; }
     constexpr const Rectangle<float>& bounds() const { return _bounds; }
 
+    // empties the tree and hands all its memory back to the arena for the next build
     void clear() {
-        _objects.clear();
-        _stuck.clear();
-        _nodes.reset();
+        _nodes = nullptr;
+        _objects = Items(_arena);
+        _stuck = Items(_arena);
+        _arena->reset();
+    }
+
+    // clears the tree and moves it to bounds
+    void reset(const Rectangle<float>& bounds) {
+        clear();
+        _bounds = bounds;
     }
 
     void insert(RefT item) {
@@ -0,0 +1,55 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+
+namespace BallSimulator {
+    // Philox4x32-10 (Salmon et al., "Parallel random numbers: as easy as 1, 2, 3"). The output
+    // is a pure function of the key and a 128 bit counter, so any thread can draw the numbers
+    // for ball i directly and the results never depend on who drew what, or in which order.
+    class Philox {
+        std::array<std::uint32_t, 2> _key;
+
+    public:
+        typedef std::array<std::uint32_t, 4> Block;
+
+        explicit constexpr Philox(std::uint64_t seed) :
+            _key{ static_cast<std::uint32_t>(seed), static_cast<std::uint32_t>(seed >> 32) } {}
+
+        constexpr Block operator ()(Block counter) const {
+            constexpr std::uint64_t M0 = 0xD2511F53, M1 = 0xCD9E8D57;
+            constexpr std::uint32_t W0 = 0x9E3779B9, W1 = 0xBB67AE85;
+
+            auto key = _key;
+            for (auto round = 0; round < 10; round++) {
+                const auto p0 = M0 * counter[0];
+                const auto p1 = M1 * counter[2];
+                counter = {
+                    static_cast<std::uint32_t>(p1 >> 32) ^ counter[1] ^ key[0], static_cast<std::uint32_t>(p1),
+                    static_cast<std::uint32_t>(p0 >> 32) ^ counter[3] ^ key[1], static_cast<std::uint32_t>(p0)
+                };
+                key[0] += W0;
+                key[1] += W1;
+            }
+            return counter;
+        }
+
+        // four words for one ball: index picks the ball, stream what the numbers are for and
+        // generation how many times that has been drawn before
+        inline constexpr Block operator ()(std::uint64_t index, std::uint32_t stream, std::uint32_t generation = 0) const {
+            return (*this)(Block{ static_cast<std::uint32_t>(index), static_cast<std::uint32_t>(index >> 32), stream, generation });
+        }
+
+        // the top 24 bits as a float in [0, 1)
+        static inline constexpr float uniform(std::uint32_t bits) {
+            return static_cast<float>(bits >> 8) * (1.0f / 16777216.0f);
+        }
+    };
+
+    enum class RandomStream : std::uint32_t {
+        POSITION,
+        VELOCITY,
+        RADIUS,
+        MASS
+    };
+}
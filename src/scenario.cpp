@@ -0,0 +1,646 @@
+#include "scenario.hpp"
+#include "world.hpp"
+#include "random.hpp"
+
+#include <algorithm>
+#include <charconv>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <memory>
+#include <type_traits>
+#include <vector>
+
+using namespace BallSimulator;
+
+namespace {
+    bool ParseFloat(std::string_view text, float& value) {
+        // from_chars takes no sign for positive numbers, but strtof always did
+        if (text.size() > 1 && text.front() == '+' && text[1] != '-') {
+            text.remove_prefix(1);
+        }
+        const auto end = text.data() + text.size();
+        const auto [last, error] = std::from_chars(text.data(), end, value);
+        return !text.empty() && error == std::errc() && last == end;
+    }
+
+    template <typename F>
+    inline void ForEachBall(ThreadPool* pool, std::size_t begin, std::size_t end, F&& f) {
+        const auto body = [&](std::size_t first, std::size_t last, unsigned) {
+            for (auto i = begin + first; i < begin + last; i++) {
+                f(i);
+            }
+        };
+        if (pool != nullptr) {
+            pool->parallel_for(end - begin, PARALLEL_GRAIN_SIZE, body);
+        } else {
+            body(0, end - begin, 0);
+        }
+    }
+
+    // constants skip the draw, which is most of the cost of generating a big population
+    inline float Sample(const Distribution& distribution, const Philox& random, std::size_t i, RandomStream stream) {
+        if (distribution.kind == Distribution::CONSTANT) {
+            return distribution.a;
+        }
+        const auto bits = random(i, static_cast<std::uint32_t>(stream));
+        return distribution.sample(Philox::uniform(bits[0]), Philox::uniform(bits[1]));
+    }
+
+    std::string FormatFloat(float value) {
+        auto text = std::to_string(value);
+        text.erase(text.find_last_not_of('0') + 1);
+        if (text.back() == '.') {
+            text.pop_back();
+        }
+        return text;
+    }
+}
+
+float Distribution::sample(float u1, float u2) const {
+    switch (kind) {
+        case CONSTANT:
+            return a;
+        case UNIFORM:
+            return a + (b - a) * u1;
+        case NORMAL: {
+            // Box-Muller, with 1 - u1 keeping the log finite
+            constexpr float twoPi = 2.0f * 3.1415926f;
+            const auto z = std::sqrt(-2.0f * std::log(1.0f - u1)) * std::cos(twoPi * u2);
+            return std::max(a + b * z, 0.001f);
+        }
+    }
+    return a;
+}
+
+float Distribution::mean() const {
+    return kind == UNIFORM ? 0.5f * (a + b) : a;
+}
+
+bool Distribution::positive() const {
+    // normal samples are clamped above zero already, but a mean that isn't describes nothing real
+    switch (kind) {
+        case CONSTANT: return std::isfinite(a) && a > 0.0f;
+        case UNIFORM:  return std::isfinite(a) && std::isfinite(b) && std::min(a, b) > 0.0f;
+        case NORMAL:   return std::isfinite(a) && std::isfinite(b) && a > 0.0f && b >= 0.0f;
+    }
+    return false;
+}
+
+Distribution Distribution::scaled(float factor) const {
+    // a is the constant, the lower end or the mean, and b the upper end or the deviation, so
+    // both scale alike
+    return { kind, a * factor, b * factor };
+}
+
+std::string Distribution::describe() const {
+    switch (kind) {
+        case CONSTANT: return FormatFloat(a);
+        case UNIFORM:  return "uniform:" + FormatFloat(a) + ":" + FormatFloat(b);
+        case NORMAL:   return "normal:" + FormatFloat(a) + ":" + FormatFloat(b);
+    }
+    return "unknown";
+}
+
+bool BallSimulator::ParseDistribution(std::string_view text, Distribution& distribution) {
+    std::vector<std::string_view> parts;
+    for (std::size_t start = 0;;) {
+        const auto end = text.find(':', start);
+        parts.push_back(text.substr(start, end == std::string_view::npos ? std::string_view::npos : end - start));
+        if (end == std::string_view::npos) {
+            break;
+        }
+        start = end + 1;
+    }
+
+    Distribution result;
+    if (parts.size() == 1) {
+        result.kind = Distribution::CONSTANT;
+        if (!ParseFloat(parts[0], result.a)) {
+            return false;
+        }
+    } else if (parts.size() == 3 && (parts[0] == "uniform" || parts[0] == "normal")) {
+        result.kind = parts[0] == "uniform" ? Distribution::UNIFORM : Distribution::NORMAL;
+        if (!ParseFloat(parts[1], result.a) || !ParseFloat(parts[2], result.b)) {
+            return false;
+        }
+    } else {
+        return false;
+    }
+
+    distribution = result;
+    return true;
+}
+
+const char* BallSimulator::ScenarioLayoutName(ScenarioLayout layout) {
+    switch (layout) {
+        case ScenarioLayout::UNIFORM:     return "uniform";
+        case ScenarioLayout::CLUSTERED:   return "clustered";
+        case ScenarioLayout::SPLIT_LINES: return "split-lines";
+        case ScenarioLayout::CRYSTAL:     return "crystal";
+        case ScenarioLayout::BIMODAL:     return "bimodal";
+        case ScenarioLayout::GIANT:       return "giant";
+    }
+    return "unknown";
+}
+
+bool BallSimulator::ParseScenarioLayout(std::string_view name, ScenarioLayout& layout) {
+    for (auto candidate : { ScenarioLayout::UNIFORM, ScenarioLayout::CLUSTERED, ScenarioLayout::SPLIT_LINES,
+        ScenarioLayout::CRYSTAL, ScenarioLayout::BIMODAL, ScenarioLayout::GIANT }) {
+        if (name == ScenarioLayoutName(candidate)) {
+            layout = candidate;
+            return true;
+        }
+    }
+    return false;
+}
+
+ScenarioFile BallSimulator::DescribeScenario(const ScenarioParameters& parameters) {
+    ScenarioFile scenario;
+    scenario.bounds = parameters.bounds;
+    scenario.gravity = parameters.gravity;
+    scenario.seed = parameters.seed;
+
+    // one random population over the whole world draws exactly what World::spawn would
+    Population population;
+    population.kind = Population::REGION;
+    population.count = parameters.balls;
+    population.region = parameters.bounds;
+    population.radius = parameters.radius;
+    population.mass = parameters.mass;
+    population.maxSpeed = parameters.maxSpeed;
+
+    const auto& bounds = parameters.bounds;
+    const auto radius = parameters.radius.mean();
+    switch (parameters.layout) {
+        case ScenarioLayout::UNIFORM:
+            scenario.populations.push_back(population);
+            break;
+
+        case ScenarioLayout::CLUSTERED:
+            population.region = { bounds.x, bounds.y, 0.5f * bounds.w, 0.5f * bounds.h };
+            scenario.populations.push_back(population);
+            break;
+
+        case ScenarioLayout::SPLIT_LINES: {
+            // a band of balls on each of the seven lines a third level tree splits at, both ways.
+            // a band is as many strips, each one ball wide, as it takes to fit its share of the
+            // balls without them overlapping along the line, and is centred on the line
+            constexpr std::uint32_t lines = 7;
+            const auto spacing = 2.0f * radius;
+            population.kind = Population::LATTICE;
+            for (std::uint32_t line = 0; line < 2 * lines; line++) {
+                const auto count = static_cast<std::uint32_t>(parameters.balls / (2 * lines) +
+                    (line < parameters.balls % (2 * lines) ? 1 : 0));
+                const auto fraction = static_cast<float>(line % lines + 1) / static_cast<float>(lines + 1);
+                const auto vertical = line < lines;
+                const auto length = vertical ? bounds.h : bounds.w;
+                const auto along = std::max(static_cast<std::uint32_t>(length / spacing), 1u);
+                const auto full = count / along;
+                const auto rest = count % along;
+                const auto strips = full + (rest > 0 ? 1 : 0);
+                const auto edge = vertical
+                    ? bounds.x + fraction * bounds.w - 0.5f * static_cast<float>(strips) * spacing
+                    : bounds.y + fraction * bounds.h - 0.5f * static_cast<float>(strips) * spacing;
+
+                // the full strips, then whatever is left spread along one more
+                const std::uint32_t across[2] = { full, rest > 0 ? 1u : 0u };
+                const std::uint32_t lengths[2] = { along, rest };
+                auto offset = edge;
+                for (auto part = 0; part < 2; part++) {
+                    if (across[part] == 0 || lengths[part] == 0) {
+                        continue;
+                    }
+                    const auto width = static_cast<float>(across[part]) * spacing;
+                    if (vertical) {
+                        population.columns = across[part];
+                        population.rows = lengths[part];
+                        population.region = { offset, bounds.y, width, bounds.h };
+                    } else {
+                        population.columns = lengths[part];
+                        population.rows = across[part];
+                        population.region = { bounds.x, offset, bounds.w, width };
+                    }
+                    scenario.populations.push_back(population);
+                    offset += width;
+                }
+            }
+            break;
+        }
+
+        case ScenarioLayout::CRYSTAL: {
+            // two rectangular lattices, the second shifted by half a cell each way, make a
+            // hexagonal one; about square when a row has sqrt(3) times as many balls as a column
+            const auto spacing = 2.0f * radius;
+            const auto rowHeight = spacing * std::sqrt(3.0f);
+            const auto half = std::max<std::size_t>((parameters.balls + 1) / 2, 1);
+            const auto rows = static_cast<std::uint32_t>(std::max(std::lround(std::sqrt(static_cast<double>(half) / std::sqrt(3.0))), 1L));
+            const auto columns = static_cast<std::uint32_t>((half + rows - 1) / rows);
+            const auto width = static_cast<float>(columns) * spacing;
+            const auto height = static_cast<float>(rows) * rowHeight;
+            const auto x = bounds.x + 0.5f * (bounds.w - width - radius);
+            const auto y = bounds.y + 0.5f * (bounds.h - height - 0.5f * rowHeight);
+
+            population.kind = Population::LATTICE;
+            population.radius = { Distribution::CONSTANT, radius };
+            population.columns = columns;
+            population.rows = rows;
+            population.region = { x, y, width, height };
+            scenario.populations.push_back(population);
+            population.region = { x + radius, y + 0.5f * rowHeight, width, height };
+            scenario.populations.push_back(population);
+            break;
+        }
+
+        case ScenarioLayout::BIMODAL: {
+            // a tenth of the balls at four times the radius, with the mass to match their area
+            constexpr float scale = 4.0f;
+            population.count = parameters.balls - parameters.balls / 10;
+            scenario.populations.push_back(population);
+            population.count = parameters.balls / 10;
+            population.radius = parameters.radius.scaled(scale);
+            population.mass = parameters.mass.scaled(scale * scale);
+            scenario.populations.push_back(population);
+            break;
+        }
+
+        case ScenarioLayout::GIANT: {
+            population.count = parameters.balls > 0 ? parameters.balls - 1 : 0;
+            scenario.populations.push_back(population);
+            if (parameters.balls > 0) {
+                const auto giant = std::min(bounds.w, bounds.h) / 8.0f;
+                const auto mass = parameters.mass.mean() * (giant / radius) * (giant / radius);
+                scenario.balls.push_back({ bounds.x + 0.5f * bounds.w, bounds.y + 0.5f * bounds.h, 0.0f, 0.0f, giant, mass });
+            }
+            break;
+        }
+    }
+    return scenario;
+}
+
+void BallSimulator::BuildScenario(World& world, const ScenarioParameters& parameters) {
+    LoadScenario(world, DescribeScenario(parameters));
+}
+
+namespace {
+    constexpr char ScenarioMagic[4] = { 'B', 'S', 'C', 'N' };
+    constexpr std::uint32_t ScenarioVersion = 1;
+
+    struct ScenarioHeader {
+        char magic[4];
+        std::uint32_t version;
+        float bounds[4];
+        float gravity;
+        std::uint32_t reserved;
+        std::uint64_t seed;
+        std::uint64_t populations;
+        std::uint64_t balls;
+    };
+
+    static_assert(std::is_trivially_copyable_v<Population>, "populations are written as raw records");
+    static_assert(std::is_trivially_copyable_v<BallRecord>, "balls are written as raw records");
+
+    typedef std::unique_ptr<std::FILE, int (*)(std::FILE*)> File;
+
+    inline std::uint64_t PopulationSize(const Population& population) {
+        return population.kind == Population::LATTICE
+            ? static_cast<std::uint64_t>(population.columns) * population.rows
+            : population.count;
+    }
+
+    // a world has to have an area for the quadtree to split and the walls to hold anything in
+    inline bool ValidBounds(const Rectangle<float>& bounds) {
+        return std::isfinite(bounds.x) && std::isfinite(bounds.y) && std::isfinite(bounds.w) && std::isfinite(bounds.h) &&
+            bounds.w > 0.0f && bounds.h > 0.0f;
+    }
+
+    // an explicit ball has its mass and size inverted when it is loaded, so neither can be zero
+    inline bool ValidBall(const BallRecord& ball) {
+        return std::isfinite(ball.x) && std::isfinite(ball.y) && std::isfinite(ball.vx) && std::isfinite(ball.vy) &&
+            std::isfinite(ball.radius) && std::isfinite(ball.mass) && ball.radius > 0.0f && ball.mass > 0.0f;
+    }
+
+    // counts balls towards the limit, so a file can't ask for more than any world is built with
+    inline bool AddBalls(std::uint64_t& total, std::uint64_t count) {
+        if (count > SCENARIO_MAX_BALLS - total) {
+            return false;
+        }
+        total += count;
+        return true;
+    }
+
+    inline std::string TooManyBalls() {
+        return "more than " + std::to_string(SCENARIO_MAX_BALLS) + " balls";
+    }
+
+    bool ReadBinary(std::FILE* file, ScenarioFile& scenario, std::string& error) {
+        ScenarioHeader header;
+        if (std::fread(&header, sizeof(header), 1, file) != 1) {
+            error = "truncated header";
+            return false;
+        }
+        if (header.version != ScenarioVersion) {
+            error = "unsupported version " + std::to_string(header.version);
+            return false;
+        }
+
+        // check the counts against the file before trusting them with an allocation
+        const auto start = std::ftell(file);
+        std::fseek(file, 0, SEEK_END);
+        const auto remaining = static_cast<std::uint64_t>(std::ftell(file) - start);
+        std::fseek(file, start, SEEK_SET);
+        if (header.populations > remaining / sizeof(Population) ||
+            header.balls * sizeof(BallRecord) != remaining - header.populations * sizeof(Population)) {
+            error = "record counts don't match the file size";
+            return false;
+        }
+
+        scenario.bounds = { header.bounds[0], header.bounds[1], header.bounds[2], header.bounds[3] };
+        if (!ValidBounds(scenario.bounds)) {
+            error = "world bounds aren't finite or have no area";
+            return false;
+        }
+        std::uint64_t total = 0;
+        if (!AddBalls(total, header.balls)) {
+            error = TooManyBalls();
+            return false;
+        }
+        scenario.gravity = header.gravity;
+        scenario.seed = header.seed;
+        scenario.populations.resize(static_cast<std::size_t>(header.populations));
+        scenario.balls.resize(static_cast<std::size_t>(header.balls));
+        if (std::fread(scenario.populations.data(), sizeof(Population), scenario.populations.size(), file) != scenario.populations.size() ||
+            std::fread(scenario.balls.data(), sizeof(BallRecord), scenario.balls.size(), file) != scenario.balls.size()) {
+            error = "truncated records";
+            return false;
+        }
+        for (const auto& population : scenario.populations) {
+            if (population.kind != Population::LATTICE && population.kind != Population::REGION) {
+                error = "unknown population kind";
+                return false;
+            }
+            if (!population.radius.positive() || !population.mass.positive()) {
+                error = "population radius or mass isn't above zero";
+                return false;
+            }
+            if (!AddBalls(total, PopulationSize(population))) {
+                error = TooManyBalls();
+                return false;
+            }
+        }
+        for (const auto& ball : scenario.balls) {
+            if (!ValidBall(ball)) {
+                error = "ball position or velocity isn't finite, or its radius or mass isn't above zero";
+                return false;
+            }
+        }
+        return true;
+    }
+
+    // reads the arguments of one text directive
+    class Tokens {
+        std::string_view _line;
+
+    public:
+        explicit Tokens(std::string_view line) : _line(line) {}
+
+        bool next(std::string_view& token) {
+            const auto begin = _line.find_first_not_of(" \t\r");
+            if (begin == std::string_view::npos) {
+                return false;
+            }
+            const auto end = std::min(_line.find_first_of(" \t\r", begin), _line.size());
+            token = _line.substr(begin, end - begin);
+            _line.remove_prefix(end);
+            return true;
+        }
+
+        bool number(float& value) {
+            std::string_view token;
+            return next(token) && ParseFloat(token, value);
+        }
+
+        template <typename T>
+        bool integer(T& value) {
+            std::string_view token;
+            if (!next(token) || token.empty()) {
+                return false;
+            }
+            const auto end = token.data() + token.size();
+            const auto [last, error] = std::from_chars(token.data(), end, value);
+            return error == std::errc() && last == end;
+        }
+    };
+
+    bool ReadPopulationOptions(Tokens& tokens, Population& population) {
+        std::string_view option, value;
+        while (tokens.next(option)) {
+            if (option == "radius" || option == "mass") {
+                auto& distribution = option == "radius" ? population.radius : population.mass;
+                if (!tokens.next(value) || !ParseDistribution(value, distribution) || !distribution.positive()) {
+                    return false;
+                }
+            } else if (option == "velocity") {
+                if (!tokens.number(population.velocity.x) || !tokens.number(population.velocity.y)) {
+                    return false;
+                }
+            } else if (option == "speed") {
+                if (!tokens.number(population.maxSpeed)) {
+                    return false;
+                }
+            } else {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    bool ReadText(std::FILE* file, ScenarioFile& scenario, std::string& error) {
+        std::string text;
+        char buffer[1 << 16];
+        for (std::size_t count; (count = std::fread(buffer, 1, sizeof(buffer), file)) > 0;) {
+            text.append(buffer, count);
+        }
+
+        std::size_t number = 0;
+        std::uint64_t total = 0;
+        for (std::size_t begin = 0; begin < text.size();) {
+            const auto end = std::min(text.find('\n', begin), text.size());
+            auto line = std::string_view(text).substr(begin, end - begin);
+            begin = end + 1;
+            number++;
+            line = line.substr(0, line.find('#'));
+
+            Tokens tokens(line);
+            std::string_view directive, extra;
+            if (!tokens.next(directive)) {
+                continue;
+            }
+
+            bool ok = false;
+            if (directive == "world") {
+                ok = tokens.number(scenario.bounds.w) && tokens.number(scenario.bounds.h) &&
+                    ValidBounds(scenario.bounds) && !tokens.next(extra);
+            } else if (directive == "gravity") {
+                ok = tokens.number(scenario.gravity) && !tokens.next(extra);
+            } else if (directive == "seed") {
+                ok = tokens.integer(scenario.seed) && !tokens.next(extra);
+            } else if (directive == "lattice" || directive == "region") {
+                Population population;
+                auto& region = population.region;
+                if (directive == "lattice") {
+                    population.kind = Population::LATTICE;
+                    ok = tokens.integer(population.columns) && tokens.integer(population.rows);
+                    population.count = PopulationSize(population);
+                } else {
+                    population.kind = Population::REGION;
+                    ok = tokens.integer(population.count);
+                }
+                ok = ok && tokens.number(region.x) && tokens.number(region.y) && tokens.number(region.w) &&
+                    tokens.number(region.h) && ReadPopulationOptions(tokens, population);
+                if (ok && !AddBalls(total, PopulationSize(population))) {
+                    error = "line " + std::to_string(number) + ": " + TooManyBalls();
+                    return false;
+                }
+                if (ok) {
+                    scenario.populations.push_back(population);
+                }
+            } else if (directive == "ball") {
+                BallRecord ball;
+                ok = tokens.number(ball.x) && tokens.number(ball.y) && tokens.number(ball.vx) && tokens.number(ball.vy) &&
+                    tokens.number(ball.radius) && tokens.number(ball.mass) && !tokens.next(extra) && ValidBall(ball);
+                if (ok && !AddBalls(total, 1)) {
+                    error = "line " + std::to_string(number) + ": " + TooManyBalls();
+                    return false;
+                }
+                if (ok) {
+                    scenario.balls.push_back(ball);
+                }
+            }
+
+            if (!ok) {
+                error = "line " + std::to_string(number) + ": can't read \"" + std::string(line) + "\"";
+                return false;
+            }
+        }
+        return true;
+    }
+
+    void WriteText(std::FILE* file, const Population& population) {
+        if (population.kind == Population::LATTICE) {
+            std::fprintf(file, "lattice %u %u", population.columns, population.rows);
+        } else {
+            std::fprintf(file, "region %llu", static_cast<unsigned long long>(population.count));
+        }
+        const auto& region = population.region;
+        std::fprintf(file, " %.9g %.9g %.9g %.9g radius %s mass %s velocity %.9g %.9g speed %.9g\n",
+            region.x, region.y, region.w, region.h, population.radius.describe().c_str(),
+            population.mass.describe().c_str(), population.velocity.x, population.velocity.y, population.maxSpeed);
+    }
+}
+
+std::size_t ScenarioFile::ball_count() const {
+    std::uint64_t count = balls.size();
+    for (const auto& population : populations) {
+        count += PopulationSize(population);
+    }
+    return static_cast<std::size_t>(count);
+}
+
+bool BallSimulator::ReadScenarioFile(const std::string& path, ScenarioFile& scenario, std::string& error) {
+    File file(std::fopen(path.c_str(), "rb"), std::fclose);
+    if (file == nullptr) {
+        error = "can't open " + path;
+        return false;
+    }
+
+    char magic[sizeof(ScenarioMagic)] = {};
+    const auto binary = std::fread(magic, 1, sizeof(magic), file.get()) == sizeof(magic) &&
+        std::memcmp(magic, ScenarioMagic, sizeof(magic)) == 0;
+    std::rewind(file.get());
+
+    scenario = ScenarioFile();
+    return binary ? ReadBinary(file.get(), scenario, error) : ReadText(file.get(), scenario, error);
+}
+
+bool BallSimulator::WriteScenarioFile(const std::string& path, const ScenarioFile& scenario, bool binary) {
+    File file(std::fopen(path.c_str(), binary ? "wb" : "w"), std::fclose);
+    if (file == nullptr) {
+        return false;
+    }
+
+    if (binary) {
+        ScenarioHeader header{};
+        std::memcpy(header.magic, ScenarioMagic, sizeof(ScenarioMagic));
+        header.version = ScenarioVersion;
+        header.bounds[0] = scenario.bounds.x;
+        header.bounds[1] = scenario.bounds.y;
+        header.bounds[2] = scenario.bounds.w;
+        header.bounds[3] = scenario.bounds.h;
+        header.gravity = scenario.gravity;
+        header.seed = scenario.seed;
+        header.populations = scenario.populations.size();
+        header.balls = scenario.balls.size();
+        std::fwrite(&header, sizeof(header), 1, file.get());
+        std::fwrite(scenario.populations.data(), sizeof(Population), scenario.populations.size(), file.get());
+        std::fwrite(scenario.balls.data(), sizeof(BallRecord), scenario.balls.size(), file.get());
+    } else {
+        std::fprintf(file.get(), "world %.9g %.9g\ngravity %.9g\nseed %llu\n", scenario.bounds.w, scenario.bounds.h,
+            scenario.gravity, static_cast<unsigned long long>(scenario.seed));
+        for (const auto& population : scenario.populations) {
+            WriteText(file.get(), population);
+        }
+        for (const auto& ball : scenario.balls) {
+            std::fprintf(file.get(), "ball %.9g %.9g %.9g %.9g %.9g %.9g\n", ball.x, ball.y, ball.vx, ball.vy, ball.radius, ball.mass);
+        }
+    }
+    return std::fflush(file.get()) == 0 && std::ferror(file.get()) == 0;
+}
+
+void BallSimulator::LoadScenario(World& world, const ScenarioFile& scenario) {
+    auto& entities = world.entities();
+    entities.clear();
+    world.resize(scenario.bounds);
+    world.set_gravity(scenario.gravity);
+    world.seed(scenario.seed);
+    entities.resize(scenario.ball_count(), Ball(1.0f, 1.0f));
+
+    // every quantity has its own stream, so changing the mass distribution leaves radii and
+    // positions exactly where they were
+    const Philox random(scenario.seed);
+    std::size_t first = 0;
+    for (const auto& population : scenario.populations) {
+        const auto count = static_cast<std::size_t>(PopulationSize(population));
+        const auto& region = population.region;
+        const auto cellWidth = population.columns > 0 ? region.w / static_cast<float>(population.columns) : 0.0f;
+        const auto cellHeight = population.rows > 0 ? region.h / static_cast<float>(population.rows) : 0.0f;
+
+        ForEachBall(world.pool(), first, first + count, [&](std::size_t i) {
+            vec2f position;
+            if (population.kind == Population::LATTICE) {
+                const auto cell = i - first;
+                position = { region.x + (static_cast<float>(cell % population.columns) + 0.5f) * cellWidth,
+                    region.y + (static_cast<float>(cell / population.columns) + 0.5f) * cellHeight };
+            } else {
+                const auto bits = random(i, static_cast<std::uint32_t>(RandomStream::POSITION));
+                position = { region.x + Philox::uniform(bits[0]) * region.w, region.y + Philox::uniform(bits[1]) * region.h };
+            }
+            auto velocity = population.velocity;
+            if (population.maxSpeed != 0.0f) {
+                const auto bits = random(i, static_cast<std::uint32_t>(RandomStream::VELOCITY));
+                velocity.x += (2.0f * Philox::uniform(bits[0]) - 1.0f) * population.maxSpeed;
+                velocity.y += (2.0f * Philox::uniform(bits[1]) - 1.0f) * population.maxSpeed;
+            }
+            entities[i] = Ball(Sample(population.mass, random, i, RandomStream::MASS),
+                Sample(population.radius, random, i, RandomStream::RADIUS), position, velocity);
+        });
+        first += count;
+    }
+
+    ForEachBall(world.pool(), first, entities.size(), [&](std::size_t i) {
+        const auto& ball = scenario.balls[i - first];
+        entities[i] = Ball(ball.mass, ball.radius, { ball.x, ball.y }, { ball.vx, ball.vy });
+    });
+}
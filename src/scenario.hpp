@@ -0,0 +1,119 @@
+#pragma once
+
+#include "rectangle.hpp"
+#include "vec2.hpp"
+#include "config.h"
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace BallSimulator {
+    class World;
+
+    // a per-ball quantity drawn from a distribution: "5" (constant), "uniform:2:8" or
+    // "normal:5:1" (mean and standard deviation, clamped to stay positive)
+    struct Distribution {
+        enum Kind { CONSTANT, UNIFORM, NORMAL };
+
+        Kind kind = CONSTANT;
+        float a = 1.0f;
+        float b = 0.0f;
+
+        // maps two uniform numbers in [0, 1) to a sample
+        float sample(float u1, float u2) const;
+        float mean() const;
+        // whether every sample is finite and above zero, as a radius or a mass has to be
+        bool positive() const;
+        // the same shape with every sample multiplied by factor
+        Distribution scaled(float factor) const;
+        std::string describe() const;
+    };
+
+    bool ParseDistribution(std::string_view text, Distribution& distribution);
+
+    // where a generated scenario puts its balls. everything but UNIFORM is a case the
+    // quadtree handles badly: CLUSTERED crowds them into the top left quadrant, SPLIT_LINES
+    // centres them on the split lines of the first three tree levels so they overhang both
+    // sides, CRYSTAL packs them touching in a hexagonal crystal in the middle of the world,
+    // BIMODAL makes a tenth of them four times the size and GIANT adds one ball an eighth of
+    // the world across to a uniform gas. sizes are based on the mean of the radius
+    // distribution, and CRYSTAL rounds the ball count up to whole lattice rows
+    enum class ScenarioLayout {
+        UNIFORM, CLUSTERED, SPLIT_LINES, CRYSTAL, BIMODAL, GIANT
+    };
+
+    const char* ScenarioLayoutName(ScenarioLayout layout);
+    bool ParseScenarioLayout(std::string_view name, ScenarioLayout& layout);
+
+    // everything needed to build a world from scratch; the same parameters and seed always
+    // give the same balls, whatever the thread count
+    struct ScenarioParameters {
+        std::size_t balls = 20;
+        Distribution radius{ Distribution::CONSTANT, 20.0f };
+        Distribution mass{ Distribution::CONSTANT, 5.0f };
+        float maxSpeed = 0.0f;      // velocity components start uniform in [-maxSpeed, maxSpeed]
+        Rectangle<float> bounds{ 0.0f, 0.0f, 1024.0f, 1024.0f };
+        float gravity = static_cast<float>(SIMULATION_GRAVITY);
+        std::uint64_t seed = SIMULATION_SEED;
+        ScenarioLayout layout = ScenarioLayout::UNIFORM;
+    };
+
+    // a block of balls in a scenario file: a columns x rows lattice filling the region, or
+    // count balls placed at random inside it. velocities are velocity plus a random part of
+    // up to maxSpeed in each component
+    struct Population {
+        enum Kind : std::uint32_t { LATTICE, REGION };
+
+        Kind kind = REGION;
+        std::uint32_t columns = 0;
+        std::uint32_t rows = 0;
+        std::uint64_t count = 0;
+        Rectangle<float> region{ 0.0f, 0.0f, 0.0f, 0.0f };
+        Distribution radius{ Distribution::CONSTANT, 20.0f };
+        Distribution mass{ Distribution::CONSTANT, 5.0f };
+        vec2f velocity = vec2f::zero();
+        float maxSpeed = 0.0f;
+    };
+
+    struct BallRecord {
+        float x, y, vx, vy, radius, mass;
+    };
+
+    // initial conditions as read from a scenario file. the text form is one directive per
+    // line, # starting a comment:
+    //
+    //   world <width> <height>
+    //   gravity <g>
+    //   seed <n>
+    //   lattice <columns> <rows> <x> <y> <w> <h> [radius <dist>] [mass <dist>] [velocity <vx> <vy>] [speed <max>]
+    //   region <count> <x> <y> <w> <h> [radius <dist>] [mass <dist>] [velocity <vx> <vy>] [speed <max>]
+    //   ball <x> <y> <vx> <vy> <radius> <mass>
+    //
+    // the binary form holds the same thing as fixed size records in native byte order
+    struct ScenarioFile {
+        Rectangle<float> bounds{ 0.0f, 0.0f, 1024.0f, 1024.0f };
+        float gravity = static_cast<float>(SIMULATION_GRAVITY);
+        std::uint64_t seed = SIMULATION_SEED;
+        std::vector<Population> populations;
+        std::vector<BallRecord> balls;
+
+        // populations first, in file order, then the explicit balls
+        std::size_t ball_count() const;
+    };
+
+    // picks the format from the first bytes of the file; error says what went wrong and where
+    bool ReadScenarioFile(const std::string& path, ScenarioFile& scenario, std::string& error);
+    bool WriteScenarioFile(const std::string& path, const ScenarioFile& scenario, bool binary);
+
+    // replaces everything in world with the scenario. the ball array is sized once and filled
+    // in parallel on the world's pool; random draws are keyed by seed and ball index as usual
+    void LoadScenario(World& world, const ScenarioFile& scenario);
+
+    // the same balls as a scenario file: a single random population for UNIFORM, the
+    // populations and balls that make up the layout otherwise
+    ScenarioFile DescribeScenario(const ScenarioParameters& parameters);
+
+    // replaces the balls, bounds, gravity and seed of world
+    void BuildScenario(World& world, const ScenarioParameters& parameters);
+}
@@ -0,0 +1,155 @@
+#include "scheduler.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <thread>
+
+#include "config.h"
+
+using namespace BallSimulator;
+
+void TaskScheduler::Worker::push_back(const Task& task) {
+    if (count == ring.size()) {
+        std::vector<Task> grown(std::max<std::size_t>(ring.size() * 2, 16));
+        for (std::size_t i = 0; i < count; i++) {
+            grown[i] = ring[(head + i) % ring.size()];
+        }
+        ring.swap(grown);
+        head = 0;
+    }
+    ring[(head + count) % ring.size()] = task;
+    count++;
+}
+
+TaskScheduler::Task TaskScheduler::Worker::pop_back() {
+    count--;
+    return ring[(head + count) % ring.size()];
+}
+
+TaskScheduler::Task TaskScheduler::Worker::pop_front() {
+    const auto task = ring[head];
+    head = (head + 1) % ring.size();
+    count--;
+    return task;
+}
+
+TaskScheduler::TaskScheduler(unsigned workers) {
+    workers = std::max(workers, 1u);
+    _stats.resize(workers);
+    for (unsigned i = 0; i < workers; i++) {
+        _workers.emplace_back(std::make_unique<Worker>());
+    }
+}
+
+void TaskScheduler::reset_stats() {
+    std::fill(std::begin(_stats), std::end(_stats), WorkerStats{});
+}
+
+bool TaskScheduler::pop(unsigned worker, Task& task) {
+    auto& queue = *_workers[worker];
+    std::lock_guard lock(queue.mutex);
+    if (queue.count == 0) {
+        return false;
+    }
+    task = queue.pop_back();
+    _queued.fetch_sub(1, std::memory_order_relaxed);
+    return true;
+}
+
+bool TaskScheduler::steal(unsigned worker, Task& task) {
+    const auto count = size();
+    for (unsigned i = 1; i < count; i++) {
+        auto& queue = *_workers[(worker + i) % count];
+        std::lock_guard lock(queue.mutex);
+        if (queue.count > 0) {
+            task = queue.pop_front();
+            _queued.fetch_sub(1, std::memory_order_relaxed);
+            return true;
+        }
+    }
+    return false;
+}
+
+void TaskScheduler::wake(bool all) {
+    // a worker bumps _parked before it rechecks for work under _parkMutex, so either it sees
+    // what changed or we see it parked; taking the lock waits until it is actually asleep
+    if (_parked.load() == 0) {
+        return;
+    }
+    {
+        std::lock_guard lock(_parkMutex);
+    }
+    if (all) {
+        _park.notify_all();
+    } else {
+        _park.notify_one();
+    }
+}
+
+void TaskScheduler::work(unsigned worker) {
+    typedef std::chrono::steady_clock clock;
+    auto& stats = _stats[worker];
+    auto idleStart = clock::now();
+    unsigned spins = 0;
+
+    Task task;
+    for (;;) {
+        bool stolen = false;
+        if (!pop(worker, task)) {
+            stolen = steal(worker, task);
+            if (!stolen) {
+                if (_outstanding.load() == 0) {
+                    break;
+                }
+                if (++spins < WORK_STEALING_SPIN_ROUNDS) {
+                    std::this_thread::yield();
+                    continue;
+                }
+
+                std::unique_lock lock(_parkMutex);
+                _parked.fetch_add(1);
+                _park.wait(lock, [&] { return _queued.load() > 0 || _outstanding.load() == 0; });
+                _parked.fetch_sub(1);
+                stats.parks++;
+                spins = 0;
+                continue;
+            }
+        }
+
+        const auto start = clock::now();
+        stats.idleSeconds += std::chrono::duration<double>(start - idleStart).count();
+        _invoke(_handler, task, worker);
+        if (_outstanding.fetch_sub(1) == 1) {
+            wake(true);
+        }
+
+        idleStart = clock::now();
+        stats.busySeconds += std::chrono::duration<double>(idleStart - start).count();
+        stats.tasks++;
+        stats.steals += stolen ? 1 : 0;
+        spins = 0;
+    }
+
+    stats.idleSeconds += std::chrono::duration<double>(clock::now() - idleStart).count();
+}
+
+void TaskScheduler::spawn(unsigned worker, const Task& task) {
+    _outstanding.fetch_add(1);
+    {
+        auto& queue = *_workers[worker];
+        std::lock_guard lock(queue.mutex);
+        queue.push_back(task);
+        _queued.fetch_add(1);
+    }
+    wake(false);
+}
+
+void TaskScheduler::start(ThreadPool* pool, const Task& root) {
+    // the root is queued before any worker starts, so none can see an empty run and leave early
+    spawn(0, root);
+    if (pool == nullptr) {
+        work(0);
+        return;
+    }
+    pool->run([this](unsigned thread) { work(thread); });
+}
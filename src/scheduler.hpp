@@ -0,0 +1,93 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <span>
+#include <vector>
+
+#include "threadpool.hpp"
+
+namespace BallSimulator {
+    // Work-stealing task scheduler. Every worker owns a deque: tasks it spawns go on the back
+    // and it pops from the back, while idle workers steal the oldest (usually largest) task
+    // from the front of someone else's. The scheduler has no threads of its own: run() puts
+    // one worker on every thread of the pool it is given, the calling thread being worker 0.
+    class TaskScheduler {
+    public:
+        // a task is plain data, so queueing one never allocates; what item points at and
+        // what kind means are up to the handler given to run()
+        struct Task {
+            const void* item = nullptr;
+            std::uint32_t kind = 0;
+        };
+
+        struct WorkerStats {
+            double busySeconds = 0.0;
+            double idleSeconds = 0.0;
+            std::uint64_t tasks = 0;
+            std::uint64_t steals = 0;
+            std::uint64_t parks = 0;
+        };
+
+    private:
+        // ring buffer; it only grows, so a warmed up scheduler stays off the heap
+        struct Worker {
+            std::mutex mutex;
+            std::vector<Task> ring;
+            std::size_t head = 0, count = 0;
+
+            void push_back(const Task& task);
+            Task pop_back();
+            Task pop_front();
+        };
+
+        typedef void (*Invoke)(const void* handler, const Task& task, unsigned worker);
+
+        std::vector<std::unique_ptr<Worker>> _workers;
+        std::vector<WorkerStats> _stats;
+        const void* _handler = nullptr;
+        Invoke _invoke = nullptr;
+        std::atomic<std::size_t> _outstanding{ 0 }, _queued{ 0 };
+
+        // idle workers spin a little, then sleep here until a task is queued or the run ends
+        std::mutex _parkMutex;
+        std::condition_variable _park;
+        std::atomic<unsigned> _parked{ 0 };
+
+        void start(ThreadPool* pool, const Task& root);
+        void work(unsigned worker);
+        bool pop(unsigned worker, Task& task);
+        bool steal(unsigned worker, Task& task);
+        void wake(bool all);
+
+    public:
+        explicit TaskScheduler(unsigned workers);
+
+        TaskScheduler(const TaskScheduler&) = delete;
+        TaskScheduler& operator =(const TaskScheduler&) = delete;
+
+        inline unsigned size() const { return static_cast<unsigned>(_workers.size()); }
+
+        // must be called from inside a task, with the worker index that task was given
+        void spawn(unsigned worker, const Task& task);
+
+        // runs handler(root, worker) and every task it spawns on the threads of pool, returning
+        // once all of it has finished; pool must have size() threads, or be null for one worker
+        template <typename F>
+        void run(ThreadPool* pool, const Task& root, const F& handler) {
+            _handler = &handler;
+            _invoke = [](const void* handler, const Task& task, unsigned worker) {
+                (*static_cast<const F*>(handler))(task, worker);
+            };
+            start(pool, root);
+            _handler = nullptr;
+            _invoke = nullptr;
+        }
+
+        inline std::span<const WorkerStats> stats() const { return _stats; }
+        void reset_stats();
+    };
+}
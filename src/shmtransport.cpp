@@ -0,0 +1,187 @@
+#include "shmtransport.hpp"
+
+#ifdef HAVE_SHARED_MEMORY_TRANSPORT
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <new>
+#include <string>
+#include <thread>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+using namespace BallSimulator;
+
+static_assert(std::atomic<std::uint64_t>::is_always_lock_free, "shared memory rings need address-free atomics");
+
+struct SharedMemoryTransport::Header {
+    std::atomic<std::uint32_t> arrived{ 0 };
+    std::atomic<std::uint32_t> generation{ 0 };
+};
+
+struct SharedMemoryTransport::Ring {
+    // head and tail count bytes ever read and written; the data follows the struct
+    alignas(64) std::atomic<std::uint64_t> head{ 0 };
+    alignas(64) std::atomic<std::uint64_t> tail{ 0 };
+
+    inline std::byte* data() { return reinterpret_cast<std::byte*>(this + 1); }
+};
+
+namespace {
+    constexpr std::size_t RingHeaderBytes = sizeof(std::uint64_t);
+
+    inline std::size_t AlignUp(std::size_t value, std::size_t alignment) {
+        return (value + alignment - 1) / alignment * alignment;
+    }
+
+    // other processes may be sharing our core, so only spin briefly before giving it up
+    template <typename F>
+    inline double SpinUntil(F&& ready) {
+        if (ready()) {
+            return 0.0;
+        }
+        const auto start = std::chrono::steady_clock::now();
+        for (unsigned spins = 0; !ready(); spins++) {
+            if (spins >= 64) {
+                std::this_thread::yield();
+            }
+        }
+        return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    }
+}
+
+std::unique_ptr<SharedMemoryTransport> SharedMemoryTransport::create(unsigned ranks, std::size_t ringBytes) {
+    static std::atomic<unsigned> counter{ 0 };
+    const auto name = "/ballsimulator-" + std::to_string(getpid()) + "-" + std::to_string(counter++);
+
+    ranks = std::max(ranks, 1u);
+    ringBytes = AlignUp(std::max<std::size_t>(ringBytes, 4096), 64);
+    const auto ringStride = sizeof(Ring) + ringBytes;
+    const auto length = AlignUp(sizeof(Header), 64) + static_cast<std::size_t>(ranks) * ranks * ringStride;
+
+    const auto fd = shm_open(name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0600);
+    if (fd < 0) {
+        return nullptr;
+    }
+    // the mapping is all anyone needs, and unlinking now means nothing is left behind on a crash
+    shm_unlink(name.c_str());
+    if (ftruncate(fd, static_cast<off_t>(length)) != 0) {
+        close(fd);
+        return nullptr;
+    }
+    auto* memory = mmap(nullptr, length, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (memory == MAP_FAILED) {
+        return nullptr;
+    }
+
+    std::unique_ptr<SharedMemoryTransport> transport(new SharedMemoryTransport());
+    transport->_memory = memory;
+    transport->_length = length;
+    transport->_ringBytes = ringBytes;
+    transport->_ranks = ranks;
+
+    new (memory) Header();
+    for (unsigned from = 0; from < ranks; from++) {
+        for (unsigned to = 0; to < ranks; to++) {
+            new (&transport->ring(from, to)) Ring();
+        }
+    }
+    return transport;
+}
+
+SharedMemoryTransport::~SharedMemoryTransport() {
+    if (_memory != nullptr) {
+        munmap(_memory, _length);
+    }
+}
+
+SharedMemoryTransport::Header& SharedMemoryTransport::header() const {
+    return *static_cast<Header*>(_memory);
+}
+
+SharedMemoryTransport::Ring& SharedMemoryTransport::ring(unsigned from, unsigned to) const {
+    auto* base = static_cast<std::byte*>(_memory) + AlignUp(sizeof(Header), 64);
+    const auto index = static_cast<std::size_t>(from) * _ranks + to;
+    return *reinterpret_cast<Ring*>(base + index * (sizeof(Ring) + _ringBytes));
+}
+
+void SharedMemoryTransport::write(Ring& ring, const std::byte* data, std::size_t count) {
+    auto tail = ring.tail.load(std::memory_order_relaxed);
+    while (count > 0) {
+        std::uint64_t head = 0;
+        _stats.waitSeconds += SpinUntil([&] {
+            head = ring.head.load(std::memory_order_acquire);
+            return tail - head < _ringBytes;
+        });
+
+        const auto offset = static_cast<std::size_t>(tail % _ringBytes);
+        const auto chunk = std::min({ count, static_cast<std::size_t>(_ringBytes - (tail - head)), _ringBytes - offset });
+        std::memcpy(ring.data() + offset, data, chunk);
+        data += chunk;
+        count -= chunk;
+        tail += chunk;
+        ring.tail.store(tail, std::memory_order_release);
+    }
+}
+
+void SharedMemoryTransport::read(Ring& ring, std::byte* data, std::size_t count) {
+    auto head = ring.head.load(std::memory_order_relaxed);
+    while (count > 0) {
+        std::uint64_t tail = 0;
+        _stats.waitSeconds += SpinUntil([&] {
+            tail = ring.tail.load(std::memory_order_acquire);
+            return tail != head;
+        });
+
+        const auto offset = static_cast<std::size_t>(head % _ringBytes);
+        const auto chunk = std::min({ count, static_cast<std::size_t>(tail - head), _ringBytes - offset });
+        std::memcpy(data, ring.data() + offset, chunk);
+        data += chunk;
+        count -= chunk;
+        head += chunk;
+        ring.head.store(head, std::memory_order_release);
+    }
+}
+
+bool SharedMemoryTransport::send(unsigned peer, std::span<const std::byte> message) {
+    // both sides may be sending to each other at once, so a message has to fit in the ring
+    // without any help from the reader or the two of them would wait on each other forever
+    if (peer >= _ranks || peer == _rank || message.size() + RingHeaderBytes > _ringBytes) {
+        return false;
+    }
+
+    auto& channel = ring(_rank, peer);
+    const std::uint64_t length = message.size();
+    write(channel, reinterpret_cast<const std::byte*>(&length), sizeof(length));
+    write(channel, message.data(), message.size());
+
+    _stats.messages++;
+    _stats.bytes += message.size();
+    return true;
+}
+
+void SharedMemoryTransport::receive(unsigned peer, std::vector<std::byte>& message) {
+    auto& channel = ring(peer, _rank);
+    std::uint64_t length = 0;
+    read(channel, reinterpret_cast<std::byte*>(&length), sizeof(length));
+    message.resize(static_cast<std::size_t>(length));
+    read(channel, message.data(), message.size());
+}
+
+void SharedMemoryTransport::barrier() {
+    auto& shared = header();
+    const auto generation = shared.generation.load(std::memory_order_acquire);
+    if (shared.arrived.fetch_add(1, std::memory_order_acq_rel) + 1 == _ranks) {
+        shared.arrived.store(0, std::memory_order_relaxed);
+        shared.generation.fetch_add(1, std::memory_order_release);
+        return;
+    }
+    _stats.waitSeconds += SpinUntil([&] {
+        return shared.generation.load(std::memory_order_acquire) != generation;
+    });
+}
+#endif
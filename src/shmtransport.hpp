@@ -0,0 +1,48 @@
+#pragma once
+
+#include "transport.hpp"
+#include <memory>
+
+#if defined(__unix__) || defined(__APPLE__)
+#define HAVE_SHARED_MEMORY_TRANSPORT
+
+namespace BallSimulator {
+    // Transport over one POSIX shared memory object holding a single-producer, single-consumer
+    // byte ring for every ordered pair of ranks and a spinning barrier. It is created before
+    // the worker processes are forked, and each of them then calls attach() with its rank.
+    class SharedMemoryTransport final : public Transport {
+        struct Header;
+        struct Ring;
+
+        void* _memory = nullptr;
+        std::size_t _length = 0;
+        std::size_t _ringBytes = 0;
+        unsigned _ranks = 0;
+        unsigned _rank = 0;
+
+        SharedMemoryTransport() = default;
+
+        Header& header() const;
+        Ring& ring(unsigned from, unsigned to) const;
+        void write(Ring& ring, const std::byte* data, std::size_t count);
+        void read(Ring& ring, std::byte* data, std::size_t count);
+
+    public:
+        ~SharedMemoryTransport();
+
+        SharedMemoryTransport(const SharedMemoryTransport&) = delete;
+        SharedMemoryTransport& operator =(const SharedMemoryTransport&) = delete;
+
+        // null if the shared memory object couldn't be created or mapped
+        static std::unique_ptr<SharedMemoryTransport> create(unsigned ranks, std::size_t ringBytes);
+        inline void attach(unsigned rank) { _rank = rank; }
+
+        inline unsigned rank() const override { return _rank; }
+        inline unsigned size() const override { return _ranks; }
+
+        bool send(unsigned peer, std::span<const std::byte> message) override;
+        void receive(unsigned peer, std::vector<std::byte>& message) override;
+        void barrier() override;
+    };
+}
+#endif
@@ -1,57 +1,492 @@
 #include "simulator.hpp"
 #include "world.hpp"
 #include "ball.hpp"
+#include "integrator.hpp"
+#include "allocations.hpp"
 
 #include <random>
 #include <iostream>
+#include <algorithm>
+#include <limits>
+#include <cmath>
+#include <array>
+#include <chrono>
+#include <span>
 
-void BallSimulator::DoQuadtreeCollisionDetection(World& world, float deltaTime) {
-    static std::vector<CollisionQuadtree::RefT> array, queued;
+using namespace BallSimulator;
+
+namespace {
+    // runs func over chunks of [0, count) on the pool, or inline when the world is single threaded
+    template <typename F>
+    void ForEachChunk(ThreadPool* pool, std::size_t count, std::size_t grain, F&& func) {
+        if (pool != nullptr) {
+            pool->parallel_for(count, grain, std::forward<F>(func));
+        } else if (count > 0) {
+            func(std::size_t(0), count, 0u);
+        }
+    }
+
+    // splits the wall time and heap use of one step into its phases
+    class PhaseTimer {
+        typedef std::chrono::steady_clock clock;
+        clock::time_point _start;
+        AllocationCounters _heap;
+
+    public:
+        explicit PhaseTimer(StepPhases& phases) : _start(clock::now()), _heap(CountAllocations()) {
+            phases.steps++;
+            ResetAllocationPeak();
+        }
+
+        // adds what happened since the previous lap to phase
+        inline void lap(PhaseStats& phase) {
+            const auto now = clock::now();
+            phase.seconds += std::chrono::duration<double>(now - _start).count();
+            _start = now;
+            if constexpr (AllocationsCounted) {
+                const auto heap = CountAllocations();
+                phase.allocations += heap.allocations - _heap.allocations;
+                phase.bytes += heap.bytes - _heap.bytes;
+                phase.peak = std::max(phase.peak, heap.peak - std::min(heap.peak, _heap.live));
+                phase.livePeak = std::max(phase.livePeak, heap.peak);
+                _heap = heap;
+                ResetAllocationPeak();
+            }
+        }
+    };
+
+    inline bool Overlaps(const Ball& a, const Ball& b) {
+        const auto totalRadius = a.radius() + b.radius();
+        return (a.get_position() - b.get_position()).length2() <= totalRadius * totalRadius;
+    }
+
+    // contacts are found in parallel but applied on one thread, as a pair response writes to both balls
+    void ResolveContactsInBufferOrder(World& world) {
+        auto& entities = world.entities();
+        for (auto& scratch : world.scratch()) {
+            for (const auto& contact : scratch.contacts) {
+                entities[contact.a].collide(entities[contact.b]);
+            }
+            scratch.contacts.clear();
+        }
+    }
+
+    // Sorts the contacts by ball index and splits them into batches where no ball appears twice.
+    // A contact goes into the batch after the last one that touched either of its balls, so
+    // every ball still sees its contacts in sorted order and the result is the same as
+    // resolving the sorted list serially, whatever the thread count.
+    void ResolveContactsInCanonicalOrder(World& world, ThreadPool* pool) {
+        typedef std::chrono::steady_clock clock;
+        const auto start = clock::now();
+
+        auto& entities = world.entities();
+        auto& ordering = world.contact_ordering();
+        auto& contacts = ordering.contacts;
+
+        contacts.clear();
+        for (auto& scratch : world.scratch()) {
+            for (const auto& contact : scratch.contacts) {
+                contacts.push_back({ std::min(contact.a, contact.b), std::max(contact.a, contact.b) });
+            }
+            scratch.contacts.clear();
+        }
+        std::sort(std::begin(contacts), std::end(contacts), [](const Contact& x, const Contact& y) {
+            return x.a != y.a ? x.a < y.a : x.b < y.b;
+        });
+        contacts.erase(std::unique(std::begin(contacts), std::end(contacts), [](const Contact& x, const Contact& y) {
+            return x.a == y.a && x.b == y.b;
+        }), std::end(contacts));
+
+        auto& nextBatch = ordering.nextBatch;
+        auto& layer = ordering.layer;
+        nextBatch.resize(entities.size(), 0);
+        layer.resize(contacts.size());
+        std::uint32_t batches = 0;
+        for (std::size_t i = 0; i < contacts.size(); i++) {
+            const auto& contact = contacts[i];
+            const auto batch = std::max(nextBatch[contact.a], nextBatch[contact.b]);
+            layer[i] = batch;
+            nextBatch[contact.a] = nextBatch[contact.b] = batch + 1;
+            batches = std::max(batches, batch + 1);
+        }
+
+        // stable counting sort by batch
+        auto& offsets = ordering.batchOffsets;
+        offsets.assign(batches + 1, 0);
+        for (auto batch : layer) {
+            offsets[batch + 1]++;
+        }
+        for (std::uint32_t i = 0; i < batches; i++) {
+            offsets[i + 1] += offsets[i];
+        }
+        ordering.batched.resize(contacts.size());
+        for (std::size_t i = 0; i < contacts.size(); i++) {
+            ordering.batched[offsets[layer[i]]++] = contacts[i];
+            nextBatch[contacts[i].a] = nextBatch[contacts[i].b] = 0;
+        }
+
+        ordering.orderingSeconds += std::chrono::duration<double>(clock::now() - start).count();
+        ordering.batches += batches;
+        ordering.steps++;
+
+        std::size_t first = 0;
+        for (std::uint32_t batch = 0; batch < batches; batch++) {
+            // offsets[batch] now holds the end of this batch
+            const auto last = static_cast<std::size_t>(offsets[batch]);
+            const auto* batchContacts = ordering.batched.data() + first;
+            ForEachChunk(pool, last - first, PARALLEL_GRAIN_SIZE, [&](std::size_t begin, std::size_t end, unsigned) {
+                for (auto i = begin; i < end; i++) {
+                    entities[batchContacts[i].a].collide(entities[batchContacts[i].b]);
+                }
+            });
+            first = last;
+        }
+    }
+
+    void ResolveContacts(World& world, ThreadPool* pool) {
+        if (world.deterministic()) {
+            ResolveContactsInCanonicalOrder(world, pool);
+        } else {
+            ResolveContactsInBufferOrder(world);
+        }
+    }
+
+    void ApplyWorldBoundaries(World& world, ThreadPool* pool) {
+        auto& entities = world.entities();
+        ForEachChunk(pool, entities.size(), PARALLEL_GRAIN_SIZE, [&](std::size_t begin, std::size_t end, unsigned) {
+            for (auto i = begin; i < end; i++) {
+                entities[i].apply_world_boundary(world);
+            }
+        });
+    }
+
+    void BuildQuadtree(World& world) {
+        auto& tree = world.quadtree();
+        tree.clear();
+        for (auto& ball : world.entities()) {
+            tree.insert(std::ref(ball));
+        }
+    }
+
+    void FindQuadtreeContacts(World& world, ThreadPool* pool) {
+        const auto& tree = world.quadtree();
+        auto& entities = world.entities();
+        const auto* base = entities.data();
+
+        ForEachChunk(pool, entities.size(), PARALLEL_GRAIN_SIZE, [&](std::size_t begin, std::size_t end, unsigned thread) {
+            auto& scratch = world.scratch()[thread];
+            for (auto i = begin; i < end; i++) {
+                auto& ballA = entities[i];
+                tree.retrieve(scratch.candidates, std::ref(ballA));
+
+                for (auto& ballB : scratch.candidates) {
+                    if (&ballB.get() != &ballA && Overlaps(ballA, ballB)) {
+                        scratch.contacts.push_back({
+                            static_cast<std::uint32_t>(i),
+                            static_cast<std::uint32_t>(&ballB.get() - base)
+                        });
+                    }
+                }
+                scratch.candidates.clear();
+            }
+        });
+    }
+
+    typedef std::array<const CollisionQuadtree*, QUADTREE_MAX_LEVELS + 1> NodeChain;
+
+    // every overlapping pair is found exactly once: at the node holding the deeper of the two
+    // balls, either against its own items or against the items of one of its ancestors
+    struct NodeCollider {
+        World& world;
+        const Ball* base;
+
+        inline void test(const CollisionQuadtree::RefT& a, const CollisionQuadtree::RefT& b, WorkerScratch& scratch) const {
+            if (Overlaps(a.get(), b.get())) {
+                scratch.contacts.push_back({
+                    static_cast<std::uint32_t>(&a.get() - base),
+                    static_cast<std::uint32_t>(&b.get() - base)
+                });
+            }
+        }
+
+        void test_within(std::span<const CollisionQuadtree::RefT> items, WorkerScratch& scratch) const {
+            for (std::size_t i = 0; i < items.size(); i++) {
+                for (auto j = i + 1; j < items.size(); j++) {
+                    test(items[i], items[j], scratch);
+                }
+            }
+        }
+
+        void test_between(std::span<const CollisionQuadtree::RefT> items,
+                std::span<const CollisionQuadtree::RefT> others, WorkerScratch& scratch) const {
+            for (const auto& a : items) {
+                for (const auto& b : others) {
+                    test(a, b, scratch);
+                }
+            }
+        }
+
+        void collide_node(const CollisionQuadtree& node, const NodeChain& chain, int depth, WorkerScratch& scratch) const {
+            test_within(node.objects(), scratch);
+            test_within(node.stuck(), scratch);
+            test_between(node.objects(), node.stuck(), scratch);
+            for (auto i = 0; i < depth; i++) {
+                test_between(node.objects(), chain[i]->objects(), scratch);
+                test_between(node.objects(), chain[i]->stuck(), scratch);
+                test_between(node.stuck(), chain[i]->objects(), scratch);
+                test_between(node.stuck(), chain[i]->stuck(), scratch);
+            }
+        }
+
+        // a task names its node and carries the node's depth; the ancestors it is tested against
+        // are found again by walking down from the root, which keeps the task two words long
+        NodeChain ancestors(const CollisionQuadtree& node, int depth) const {
+            // the centre of a node is well clear of every edge its ancestors' quadrants share
+            const auto& bounds = node.bounds();
+            const vec2f centre{ bounds.x + bounds.w * 0.5f, bounds.y + bounds.h * 0.5f };
+            NodeChain chain{};
+            const auto* current = &world.quadtree();
+            for (auto i = 0; i < depth; i++) {
+                chain[i] = current;
+                current->for_each_node([&](const CollisionQuadtree& child) {
+                    const auto& quadrant = child.bounds();
+                    if (centre.x >= quadrant.x && centre.x < quadrant.x + quadrant.w &&
+                        centre.y >= quadrant.y && centre.y < quadrant.y + quadrant.h) {
+                        current = &child;
+                    }
+                });
+            }
+            return chain;
+        }
+
+        void run(TaskScheduler& scheduler, const TaskScheduler::Task& task, unsigned worker) const {
+            const auto& node = *static_cast<const CollisionQuadtree*>(task.item);
+            const auto depth = static_cast<int>(task.kind);
+            auto& scratch = world.scratch()[worker];
+            auto chain = ancestors(node, depth);
+
+            collide_node(node, chain, depth, scratch);
+            if (!node.has_child_nodes()) {
+                return;
+            }
 
+            chain[depth] = &node;
+            node.for_each_node([&](const CollisionQuadtree& child) {
+                // subtrees and crowded leaves become tasks others can steal; small leaves are
+                // cheaper to finish here than to queue
+                if (child.has_child_nodes() ||
+                    child.objects().size() + child.stuck().size() >= WORK_STEALING_MIN_LEAF_TASK) {
+                    scheduler.spawn(worker, { &child, static_cast<std::uint32_t>(depth + 1) });
+                } else {
+                    collide_node(child, chain, depth + 1, scratch);
+                }
+            });
+        }
+    };
+
+    void FindContactsByWorkStealing(World& world, TaskScheduler& scheduler) {
+        const NodeCollider collider{ world, world.entities().data() };
+        scheduler.run(world.pool(), { &world.quadtree(), 0 }, [&](const TaskScheduler::Task& task, unsigned worker) {
+            collider.run(scheduler, task, worker);
+        });
+    }
+
+    // chunks go to whichever thread is free, so next step any thread may need the room the
+    // busiest one needed this step; growing them all to match keeps later steps off the heap
+    void ShareScratchCapacity(World& world) {
+        std::size_t candidates = 0, contacts = 0;
+        for (const auto& scratch : world.scratch()) {
+            candidates = std::max(candidates, scratch.candidates.capacity());
+            contacts = std::max(contacts, scratch.contacts.capacity());
+        }
+        for (auto& scratch : world.scratch()) {
+            scratch.candidates.reserve(candidates);
+            scratch.contacts.reserve(contacts);
+        }
+    }
+
+    void FindSimpleContacts(World& world, ThreadPool* pool) {
+        auto& entities = world.entities();
+
+        // rows shrink towards the end of the triangle, so hand them out in small chunks
+        ForEachChunk(pool, entities.size(), PARALLEL_GRAIN_SIZE / 16, [&](std::size_t begin, std::size_t end, unsigned thread) {
+            auto& scratch = world.scratch()[thread];
+            for (auto i = begin; i < end; i++) {
+                for (auto j = i + 1; j < entities.size(); j++) {
+                    if (Overlaps(entities[i], entities[j])) {
+                        scratch.contacts.push_back({ static_cast<std::uint32_t>(i), static_cast<std::uint32_t>(j) });
+                    }
+                }
+            }
+        });
+    }
+}
+
+const char* BallSimulator::ThreadingModeName(ThreadingMode mode) {
+    switch (mode) {
+        case ThreadingMode::SHARED_TREE:          return "shared";
+        case ThreadingMode::DOMAIN_DECOMPOSITION: return "domain";
+        case ThreadingMode::WORK_STEALING:        return "stealing";
+    }
+    return "unknown";
+}
+
+bool BallSimulator::ParseThreadingMode(std::string_view name, ThreadingMode& mode) {
+    for (auto candidate : {
+        ThreadingMode::SHARED_TREE, ThreadingMode::DOMAIN_DECOMPOSITION, ThreadingMode::WORK_STEALING
+    }) {
+        if (name == ThreadingModeName(candidate)) {
+            mode = candidate;
+            return true;
+        }
+    }
+    return false;
+}
+
+const char* BallSimulator::BroadphaseName(Broadphase broadphase) {
+    switch (broadphase) {
+        case Broadphase::QUADTREE:    return "quadtree";
+        case Broadphase::BRUTE_FORCE: return "brute";
+    }
+    return "unknown";
+}
+
+bool BallSimulator::ParseBroadphase(std::string_view name, Broadphase& broadphase) {
+    for (auto candidate : { Broadphase::QUADTREE, Broadphase::BRUTE_FORCE }) {
+        if (name == BroadphaseName(candidate)) {
+            broadphase = candidate;
+            return true;
+        }
+    }
+    return false;
+}
+
+BallSimulator::StepFunction BallSimulator::BroadphaseStep(Broadphase broadphase) {
+    return broadphase == Broadphase::BRUTE_FORCE ? DoSimpleCollisionDetection : DoQuadtreeCollisionDetection;
+}
+
+void BallSimulator::DoQuadtreeCollisionDetection(World& world, float deltaTime) {
     deltaTime *= SIMULATION_TIMESCALE;
+    auto& phases = world.phases();
+    PhaseTimer timer(phases);
+    Integrate(world, deltaTime);
+    timer.lap(phases.integrate);
+
+    // strips depend on the thread count, so deterministic runs always use the shared tree
+    auto pool = world.pool();
+    const auto mode = world.threading_mode();
+    if (pool != nullptr && mode == ThreadingMode::DOMAIN_DECOMPOSITION && !world.deterministic()) {
+        world.domain().step(world, *pool);
+        timer.lap(phases.contacts);
+        return;
+    }
+
+    if (pool != nullptr || world.deterministic()) {
+        BuildQuadtree(world);
+        timer.lap(phases.build);
+        if (mode == ThreadingMode::WORK_STEALING) {
+            FindContactsByWorkStealing(world, world.scheduler());
+        } else {
+            FindQuadtreeContacts(world, pool);
+        }
+        ShareScratchCapacity(world);
+        timer.lap(phases.contacts);
+        ResolveContacts(world, pool);
+        timer.lap(phases.resolve);
+        ApplyWorldBoundaries(world, pool);
+        timer.lap(phases.boundaries);
+        return;
+    }
+
     auto& tree = world.quadtree();
+    auto& queued = world.scratch().front().candidates;
 
     tree.clear();
 
-    const auto& entities = world.entities();
-    auto i = 0;
-    array.reserve(entities.size());
+    auto& entities = world.entities();
     for (auto& ball : entities) {
-        ball->update(world, deltaTime);
-        tree.insert(std::ref(*ball));
-        array.emplace_back(std::ref(*ball));
+        tree.insert(std::ref(ball));
     }
+    timer.lap(phases.build);
 
-    for (auto& ballA : array) {
-        tree.retrieve(queued, ballA);
+    for (auto& ballA : entities) {
+        tree.retrieve(queued, std::ref(ballA));
 
         for (auto& ballB : queued) {
-            if (&ballB.get() != &ballA.get()) {
-                ballA.get().collide(ballB);
+            if (&ballB.get() != &ballA) {
+                ballA.collide(ballB);
             }
         }
 
-        ballA.get().apply_world_boundary(world);
+        ballA.apply_world_boundary(world);
         queued.clear();
     }
-    array.clear();
+    timer.lap(phases.contacts);
 }
 
 void BallSimulator::DoSimpleCollisionDetection(World& world, float deltaTime) {
     deltaTime *= SIMULATION_TIMESCALE;
     auto& entities = world.entities();
+    auto& phases = world.phases();
+    PhaseTimer timer(phases);
 
-    for (auto& ball : entities) {
-        ball->update(world, deltaTime);
+    Integrate(world, deltaTime);
+    timer.lap(phases.integrate);
+
+    auto pool = world.pool();
+    if (pool != nullptr || world.deterministic()) {
+        FindSimpleContacts(world, pool);
+        ShareScratchCapacity(world);
+        timer.lap(phases.contacts);
+        ResolveContacts(world, pool);
+        timer.lap(phases.resolve);
+        ApplyWorldBoundaries(world, pool);
+        timer.lap(phases.boundaries);
+        return;
     }
 
     for (unsigned long i = 0; i < entities.size(); i++) {
         auto& b = entities.at(i);
 
         for (auto j = i + 1; j < entities.size(); j++) {
-            b->collide(*entities.at(j));
+            b.collide(entities.at(j));
         }
 
-        b->apply_world_boundary(world);
+        b.apply_world_boundary(world);
+    }
+    timer.lap(phases.contacts);
+}
+
+BallSimulator::StepInfo BallSimulator::DoAdaptiveStep(World& world, float deltaTime, StepFunction step) {
+    const auto& policy = world.substep_policy();
+    const auto scaledDeltaTime = static_cast<float>(deltaTime * SIMULATION_TIMESCALE);
+
+    float maxSpeed2 = 0.0f;
+    float minRadius = std::numeric_limits<float>::max();
+    for (const auto& ball : world.entities()) {
+        maxSpeed2 = std::max(maxSpeed2, ball.get_velocity().length2());
+        minRadius = std::min(minRadius, ball.radius());
+    }
+
+    StepInfo info{ 1, deltaTime, 0.0f };
+    if (minRadius > 0.0f && minRadius != std::numeric_limits<float>::max()) {
+        // gravity can only add |g| * dt of speed over the whole step, so fold that into the bound
+        const auto maxSpeed = std::sqrt(maxSpeed2) + std::abs(world.gravity()) * scaledDeltaTime;
+        info.maxVelocityRatio = maxSpeed / minRadius;
+
+        const auto maxDisplacement = std::max(policy.maxDisplacement, Epsilon);
+        const auto required = std::ceil(info.maxVelocityRatio * scaledDeltaTime / maxDisplacement);
+        // a velocity or gravity that isn't finite leaves no bound to meet, so take the most allowed
+        const auto substeps = std::isfinite(required)
+            ? std::min(required, static_cast<float>(policy.maxSubsteps))
+            : static_cast<float>(policy.maxSubsteps);
+        info.substeps = std::clamp(static_cast<int>(substeps), 1, std::max(policy.maxSubsteps, 1));
+        info.deltaTime = deltaTime / static_cast<float>(info.substeps);
     }
+
+    for (auto i = 0; i < info.substeps; i++) {
+        step(world, info.deltaTime);
+    }
+
+    return info;
 }
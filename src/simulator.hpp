@@ -1,6 +1,8 @@
 #pragma once
 
 #include <vector>
+#include <cstdint>
+#include <string_view>
 
 #include "vec2.hpp"
 #include "quadtree.hpp"
@@ -19,6 +21,86 @@ namespace BallSimulator {
 
     typedef Quadtree<Ball, QUADTREE_MAX_OBJECTS, QUADTREE_MAX_LEVELS> CollisionQuadtree;
 
+    // how a multi-threaded world splits its work: one shared quadtree queried from every thread,
+    // one strip of the world per thread with its own broadphase over the shared balls, or
+    // one task per quadtree node balanced across threads by work stealing
+    enum class ThreadingMode {
+        SHARED_TREE, DOMAIN_DECOMPOSITION, WORK_STEALING
+    };
+
+    const char* ThreadingModeName(ThreadingMode mode);
+    bool ParseThreadingMode(std::string_view name, ThreadingMode& mode);
+
+    // a pair of overlapping balls, as indices into World::entities()
+    struct Contact {
+        std::uint32_t a, b;
+    };
+
+    // scratch and counters for resolving contacts in a canonical order that doesn't depend on
+    // the thread count (see World::set_deterministic)
+    struct ContactOrdering {
+        std::vector<Contact> contacts;   // sorted by (a, b), duplicates removed
+        std::vector<Contact> batched;    // the same contacts grouped into conflict-free batches
+        std::vector<std::uint32_t> layer, batchOffsets, nextBatch;
+        double orderingSeconds = 0.0;    // time spent sorting and batching: the cost of determinism
+        std::uint64_t steps = 0, batches = 0;
+    };
+
+    // wall time and heap use of one phase of the collision steps, summed over steps. the heap
+    // is only counted in COUNT_ALLOCATIONS builds (see allocations.hpp)
+    struct PhaseStats {
+        double seconds = 0.0;
+        std::uint64_t allocations = 0;
+        std::uint64_t bytes = 0;
+        std::size_t peak = 0;       // most bytes the heap grew above the start of the phase, in any step
+        std::size_t livePeak = 0;   // most bytes live at once during the phase, in any step
+    };
+
+    // the single threaded steps resolve and bound each ball as soon as its contacts are found,
+    // and a domain decomposed step does all of that per strip, so they count it all as contacts
+    struct StepPhases {
+        PhaseStats integrate;
+        PhaseStats build;
+        PhaseStats contacts;
+        PhaseStats resolve;
+        PhaseStats boundaries;
+        std::uint64_t steps = 0;
+
+        inline double seconds() const {
+            return integrate.seconds + build.seconds + contacts.seconds + resolve.seconds + boundaries.seconds;
+        }
+    };
+
+    // per-thread buffers reused between steps by the parallel broadphase
+    struct WorkerScratch {
+        std::vector<CollisionQuadtree::RefT> candidates;
+        std::vector<Contact> contacts;
+    };
+
+    // substeps are chosen so that no ball moves further than maxDisplacement * (minimum radius)
+    // within a single substep, capped at maxSubsteps
+    struct SubstepPolicy {
+        float maxDisplacement = SUBSTEP_MAX_DISPLACEMENT;
+        int maxSubsteps = SUBSTEP_MAX_COUNT;
+    };
+
+    struct StepInfo {
+        int substeps;
+        float deltaTime;   // per substep, in the same (unscaled) units as the requested step
+        float maxVelocityRatio;   // max |v| / min radius at the start of the step
+    };
+
+    typedef void (*StepFunction)(World& world, float deltaTime);
+
     void DoQuadtreeCollisionDetection(World& world, float deltaTime);
     void DoSimpleCollisionDetection(World& world, float deltaTime);
+
+    enum class Broadphase {
+        QUADTREE, BRUTE_FORCE
+    };
+
+    const char* BroadphaseName(Broadphase broadphase);
+    bool ParseBroadphase(std::string_view name, Broadphase& broadphase);
+    StepFunction BroadphaseStep(Broadphase broadphase);
+    StepInfo DoAdaptiveStep(World& world, float deltaTime, StepFunction step);
 }
@@ -0,0 +1,24 @@
+#pragma once
+
+#include "vec2.hpp"
+#include "rectangle.hpp"
+#include <cstdint>
+#include <vector>
+
+// Immutable view of one simulation step, published by the simulation thread for the renderer.
+// Positions from the step before are kept alongside so frames can interpolate between them.
+struct SimulationSnapshot {
+    struct Cell {
+        Rectangle<float> bounds;
+        std::uint32_t count;
+    };
+
+    std::vector<vec2f> previous, positions;
+    std::vector<float> radii;
+    std::vector<std::uint8_t> flash;
+    std::vector<Rectangle<float>> quads;   // quadtree nodes that were split
+    std::vector<Cell> cells;               // occupied leaves, for the heatmap
+
+    double timestamp = 0.0;   // seconds on the simulation clock when this was published
+    double stepTime = 0.0;
+};
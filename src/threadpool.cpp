@@ -0,0 +1,88 @@
+#include "threadpool.hpp"
+
+#include <chrono>
+
+using namespace BallSimulator;
+
+namespace {
+    // runs job on thread and adds the time it took to busy
+    inline void RunTimed(const std::function<void(unsigned)>& job, unsigned thread, double& busy) {
+        const auto start = std::chrono::steady_clock::now();
+        job(thread);
+        busy += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    }
+}
+
+ThreadPool::ThreadPool(unsigned threads) {
+    threads = std::max(threads, 1u);
+    _busy.assign(threads, 0.0);
+    _workers.reserve(threads - 1);
+    for (unsigned i = 1; i < threads; i++) {
+        _workers.emplace_back(&ThreadPool::worker, this, i);
+    }
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard lock(_mutex);
+        _stop = true;
+    }
+    _wake.notify_all();
+    for (auto& worker : _workers) {
+        worker.join();
+    }
+}
+
+unsigned ThreadPool::hardware_threads() {
+    return std::max(std::thread::hardware_concurrency(), 1u);
+}
+
+void ThreadPool::worker(unsigned thread) {
+    std::uint64_t seen = 0;
+    for (;;) {
+        const std::function<void(unsigned)>* job;
+        {
+            std::unique_lock lock(_mutex);
+            _wake.wait(lock, [&] { return _stop || _generation != seen; });
+            if (_stop) {
+                return;
+            }
+            seen = _generation;
+            job = _job;
+        }
+
+        RunTimed(*job, thread, _busy[thread]);
+
+        {
+            std::lock_guard lock(_mutex);
+            if (--_pending == 0) {
+                _done.notify_one();
+            }
+        }
+    }
+}
+
+void ThreadPool::reset_stats() {
+    std::fill(std::begin(_busy), std::end(_busy), 0.0);
+}
+
+void ThreadPool::run_job(const std::function<void(unsigned)>& job) {
+    if (_workers.empty()) {
+        RunTimed(job, 0, _busy[0]);
+        return;
+    }
+
+    {
+        std::lock_guard lock(_mutex);
+        _job = &job;
+        _pending = static_cast<unsigned>(_workers.size());
+        _generation++;
+    }
+    _wake.notify_all();
+
+    RunTimed(job, 0, _busy[0]);
+
+    std::unique_lock lock(_mutex);
+    _done.wait(lock, [&] { return _pending == 0; });
+    _job = nullptr;
+}
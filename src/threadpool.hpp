@@ -0,0 +1,79 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <span>
+#include <thread>
+#include <vector>
+
+namespace BallSimulator {
+    // Persistent pool of worker threads. The calling thread takes part in every job as
+    // thread 0, so a pool of size 1 owns no workers and runs everything inline.
+    class ThreadPool {
+        std::vector<std::thread> _workers;
+        std::vector<double> _busy;
+        std::mutex _mutex;
+        std::condition_variable _wake, _done;
+        const std::function<void(unsigned)>* _job = nullptr;
+        std::uint64_t _generation = 0;
+        unsigned _pending = 0;
+        bool _stop = false;
+
+        void worker(unsigned thread);
+        void run_job(const std::function<void(unsigned)>& job);
+
+    public:
+        explicit ThreadPool(unsigned threads);
+        ~ThreadPool();
+
+        ThreadPool(const ThreadPool&) = delete;
+        ThreadPool& operator =(const ThreadPool&) = delete;
+
+        inline unsigned size() const { return static_cast<unsigned>(_workers.size()) + 1; }
+
+        static unsigned hardware_threads();
+
+        // runs job(thread) once on every thread in the pool and waits for all of them
+        template <typename F>
+        void run(F&& job) {
+            // handing the workers a reference keeps any job small enough for std::function to
+            // hold without allocating
+            run_job([&job](unsigned thread) { job(thread); });
+        }
+
+        // seconds each thread has spent inside run() jobs since the last reset; the spread
+        // between them is the load imbalance of the parallel phases
+        inline std::span<const double> busy_seconds() const { return _busy; }
+        void reset_stats();
+
+        // splits [0, count) into chunks of at most grain items, handed out dynamically;
+        // func(begin, end, thread) is called for each chunk
+        template <typename F>
+        void parallel_for(std::size_t count, std::size_t grain, F&& func) {
+            if (count == 0) {
+                return;
+            }
+            grain = std::max<std::size_t>(grain, 1);
+            if (size() == 1 || count <= grain) {
+                func(std::size_t(0), count, 0u);
+                return;
+            }
+
+            std::atomic<std::size_t> next{ 0 };
+            run([&](unsigned thread) {
+                for (;;) {
+                    auto begin = next.fetch_add(grain, std::memory_order_relaxed);
+                    if (begin >= count) {
+                        break;
+                    }
+                    func(begin, std::min(begin + grain, count), thread);
+                }
+            });
+        }
+    };
+}
@@ -0,0 +1,215 @@
+#pragma once
+
+#include <algorithm>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace BallSimulator {
+    // Trajectory files hold every ball's position and velocity for a run of recorded frames.
+    //
+    //   TrajectoryHeader
+    //   radius and mass of every ball (two floats each, they never change)
+    //   chunks, one after another
+    //   TrajectoryIndexEntry for every chunk
+    //   TrajectoryFooter
+    //
+    // A chunk covers up to framesPerChunk consecutive frames and stores the columns x, y, vx
+    // and vy one after another, each ball by ball: a ball's first value in the chunk as a
+    // varint, then every following frame as its difference from a straight line through the
+    // two before (from the one before, for the second frame), zigzagged, in groups of
+    // TrajectoryPackGroup. Each group starts with a byte holding either the bit width its
+    // values are packed at or TrajectoryVarintGroup if they follow as varints, whichever is
+    // shorter: a ball moving steadily costs a few bits a frame, and a collision or the noise
+    // in the low bits of a float only costs its own group. No chunk depends on an earlier
+    // one, so every chunk start is a keyframe. Each column begins with the byte offset of
+    // every ballBlock'th ball within it, so a reader can jump to one ball without decoding
+    // the rest. Everything is in native byte order.
+    //
+    // LOSSLESS columns predict and difference the bit patterns of the floats. QUANTISED columns
+    // first round every value to the fixed-point step the chunk header gives the column, as an
+    // offset from the world origin for positions and from zero for velocities, then predict and
+    // difference those integers; their first value is zigzagged too. The step is a little under
+    // twice the header's error bound, so a value decoded in double precision and then rounded
+    // to float still lands within the bound. A column whose step would be zero is lossless, so
+    // in a QUANTISED file a column that can't be quantised (a value that isn't finite, or is
+    // too far from the origin, or too large for a float to hold within the bound) is stored
+    // exactly instead.
+    enum class TrajectoryCodec : std::uint32_t { LOSSLESS, QUANTISED };
+
+    constexpr std::uint32_t TrajectoryColumns = 4;
+    constexpr std::uint32_t TrajectoryPackGroup = 8;
+    constexpr std::uint8_t TrajectoryVarintGroup = 0x80;
+    constexpr char TrajectoryMagic[8] = { 'B', 'S', 'T', 'R', 'A', 'J', '\0', '\0' };
+    constexpr char TrajectoryFooterMagic[8] = { 'B', 'S', 'T', 'R', 'I', 'D', 'X', '\0' };
+    constexpr std::uint32_t TrajectoryVersion = 2;
+
+    struct TrajectoryHeader {
+        char magic[8];
+        std::uint32_t version;
+        TrajectoryCodec codec;
+        std::uint64_t balls;
+        std::uint32_t framesPerChunk;
+        std::uint32_t ballBlock;
+        float bounds[4];
+        float frameTime;                // simulated seconds between recorded frames
+        float errorBound;               // largest absolute error of a QUANTISED value
+        std::uint8_t reserved[8];
+    };
+
+    struct TrajectoryChunkHeader {
+        std::uint64_t firstFrame;
+        std::uint32_t frames;
+        std::uint32_t blocks;                               // block offsets at the start of each column
+        std::uint64_t columnBytes[TrajectoryColumns];       // each including its block offsets
+        float quantum[TrajectoryColumns];                   // fixed-point step, 0 for a lossless column
+    };
+
+    struct TrajectoryIndexEntry {
+        std::uint64_t firstFrame;
+        std::uint64_t offset;
+        std::uint64_t bytes;
+        std::uint32_t frames;
+        std::uint32_t reserved;
+    };
+
+    struct TrajectoryFooter {
+        std::uint64_t indexOffset;
+        std::uint64_t chunks;
+        std::uint64_t frames;
+        char magic[8];
+    };
+
+    // floats are differenced as the integers their bits make, which stays small while the sign
+    // and exponent stay put, then zigzagged so small steps either way give short varints
+    inline std::uint32_t ZigZag(std::int32_t value) {
+        return (static_cast<std::uint32_t>(value) << 1) ^ static_cast<std::uint32_t>(value >> 31);
+    }
+
+    inline std::int32_t UnZigZag(std::uint32_t value) {
+        return static_cast<std::int32_t>(value >> 1) ^ -static_cast<std::int32_t>(value & 1);
+    }
+
+    // where the fixed-point values of a QUANTISED column count from
+    inline float TrajectoryOrigin(const TrajectoryHeader& header, std::uint32_t column) {
+        return column < 2 ? header.bounds[column] : 0.0f;
+    }
+
+    inline unsigned VarintBytes(std::uint32_t value) {
+        return 1 + (32 - std::countl_zero(value | 1) - 1) / 7;
+    }
+
+    inline void PutVarint(std::vector<std::uint8_t>& out, std::uint32_t value) {
+        while (value >= 0x80) {
+            out.push_back(static_cast<std::uint8_t>(value | 0x80));
+            value >>= 7;
+        }
+        out.push_back(static_cast<std::uint8_t>(value));
+    }
+
+    // stops at end rather than reading past it on a corrupt stream
+    inline std::uint32_t GetVarint(const std::uint8_t*& data, const std::uint8_t* end) {
+        std::uint32_t value = 0;
+        for (unsigned shift = 0; data < end && shift < 32; shift += 7) {
+            const auto byte = *data++;
+            value |= static_cast<std::uint32_t>(byte & 0x7F) << shift;
+            if ((byte & 0x80) == 0) {
+                break;
+            }
+        }
+        return value;
+    }
+
+    // one group of at most TrajectoryPackGroup values, in whichever form is shorter
+    inline void PutGroup(std::vector<std::uint8_t>& out, const std::uint32_t* values, std::uint32_t count) {
+        std::uint32_t combined = 0;
+        unsigned varintBytes = 0;
+        for (std::uint32_t i = 0; i < count; i++) {
+            combined |= values[i];
+            varintBytes += VarintBytes(values[i]);
+        }
+        const auto width = static_cast<unsigned>(32 - std::countl_zero(combined));
+        if (varintBytes < (count * width + 7) / 8) {
+            out.push_back(TrajectoryVarintGroup);
+            for (std::uint32_t i = 0; i < count; i++) {
+                PutVarint(out, values[i]);
+            }
+            return;
+        }
+
+        out.push_back(static_cast<std::uint8_t>(width));
+        std::uint64_t buffer = 0;
+        unsigned buffered = 0;
+        for (std::uint32_t i = 0; i < count && width > 0; i++) {
+            buffer |= static_cast<std::uint64_t>(values[i]) << buffered;
+            buffered += width;
+            while (buffered >= 8) {
+                out.push_back(static_cast<std::uint8_t>(buffer));
+                buffer >>= 8;
+                buffered -= 8;
+            }
+        }
+        if (buffered > 0) {
+            out.push_back(static_cast<std::uint8_t>(buffer));
+        }
+    }
+
+    // stops at end rather than reading past it on a corrupt stream
+    inline void GetGroup(const std::uint8_t*& data, const std::uint8_t* end, std::uint32_t* values, std::uint32_t count) {
+        const auto tag = data < end ? *data++ : 0;
+        if (tag == TrajectoryVarintGroup) {
+            for (std::uint32_t i = 0; i < count; i++) {
+                values[i] = GetVarint(data, end);
+            }
+            return;
+        }
+
+        const auto width = std::min<unsigned>(tag, 32);
+        const auto mask = width == 32 ? ~0u : (1u << width) - 1;
+        std::uint64_t buffer = 0;
+        unsigned buffered = 0;
+        for (std::uint32_t i = 0; i < count; i++) {
+            while (buffered < width && data < end) {
+                buffer |= static_cast<std::uint64_t>(*data++) << buffered;
+                buffered += 8;
+            }
+            values[i] = static_cast<std::uint32_t>(buffer) & mask;
+            buffer >>= width;
+            buffered = buffered >= width ? buffered - width : 0;
+        }
+    }
+
+    // moves data past a group without unpacking it
+    inline void SkipGroup(const std::uint8_t*& data, const std::uint8_t* end, std::uint32_t count) {
+        const auto tag = data < end ? *data++ : 0;
+        if (tag == TrajectoryVarintGroup) {
+            for (std::uint32_t i = 0; i < count && data < end; ) {
+                if ((*data++ & 0x80) == 0) {
+                    i++;
+                }
+            }
+            return;
+        }
+        const auto bytes = (count * std::min<unsigned>(tag, 32) + 7) / 8;
+        data += std::min<std::size_t>(bytes, static_cast<std::size_t>(end - data));
+    }
+
+    inline void PutResiduals(std::vector<std::uint8_t>& out, const std::uint32_t* values, std::uint32_t count) {
+        for (std::uint32_t first = 0; first < count; first += TrajectoryPackGroup) {
+            PutGroup(out, values + first, std::min(TrajectoryPackGroup, count - first));
+        }
+    }
+
+    inline void GetResiduals(const std::uint8_t*& data, const std::uint8_t* end, std::uint32_t* values, std::uint32_t count) {
+        for (std::uint32_t first = 0; first < count; first += TrajectoryPackGroup) {
+            GetGroup(data, end, values + first, std::min(TrajectoryPackGroup, count - first));
+        }
+    }
+
+    inline void SkipResiduals(const std::uint8_t*& data, const std::uint8_t* end, std::uint32_t count) {
+        for (std::uint32_t first = 0; first < count; first += TrajectoryPackGroup) {
+            SkipGroup(data, end, std::min(TrajectoryPackGroup, count - first));
+        }
+    }
+}
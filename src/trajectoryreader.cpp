@@ -0,0 +1,296 @@
+#include "trajectoryreader.hpp"
+
+#include <algorithm>
+#include <bit>
+#include <cmath>
+#include <cstring>
+#include <iterator>
+
+using namespace BallSimulator;
+
+namespace {
+    // reverses TrajectoryWriter::encode_lossless and encode_quantised for the first wanted of
+    // the frames in one ball's column, writing them stride floats apart, and moves data past
+    // the rest
+    void DecodeSeries(const TrajectoryHeader& header, const TrajectoryChunkHeader& chunk, std::uint32_t column,
+        const std::uint8_t*& data, const std::uint8_t* end, std::uint32_t frames, std::uint32_t wanted,
+        std::uint32_t* residuals, float* out, std::size_t stride) {
+        const double quantum = chunk.quantum[column];
+        const auto quantised = quantum > 0.0;
+        const double origin = TrajectoryOrigin(header, column);
+
+        auto previous = GetVarint(data, end);
+        if (quantised) {
+            previous = static_cast<std::uint32_t>(UnZigZag(previous));
+        }
+        // groups can only be unpacked whole
+        const auto unpacked = std::min((wanted - 1 + TrajectoryPackGroup - 1) / TrajectoryPackGroup * TrajectoryPackGroup,
+            frames - 1);
+        GetResiduals(data, end, residuals, unpacked);
+        SkipResiduals(data, end, frames - 1 - unpacked);
+
+        std::uint32_t step = 0;
+        for (std::uint32_t frame = 0; frame < wanted; frame++) {
+            if (frame > 0) {
+                const auto bits = previous + step + static_cast<std::uint32_t>(UnZigZag(residuals[frame - 1]));
+                step = bits - previous;
+                previous = bits;
+            }
+            out[frame * stride] = quantised ?
+                static_cast<float>(origin + static_cast<std::int32_t>(previous) * quantum) :
+                std::bit_cast<float>(previous);
+        }
+    }
+
+    void SkipSeries(const std::uint8_t*& data, const std::uint8_t* end, std::uint32_t frames) {
+        GetVarint(data, end);
+        SkipResiduals(data, end, frames - 1);
+    }
+}
+
+std::unique_ptr<TrajectoryReader> TrajectoryReader::open(const std::string& path, std::string& error) {
+    auto file = MappedFile::open(path);
+    if (file == nullptr) {
+        error = "can't open " + path;
+        return nullptr;
+    }
+
+    std::unique_ptr<TrajectoryReader> reader(new TrajectoryReader());
+    auto& header = reader->_header;
+    auto& footer = reader->_footer;
+    const auto bytes = file->bytes();
+    if (bytes.size() < sizeof(header) + sizeof(footer)) {
+        error = "truncated trajectory";
+        return nullptr;
+    }
+    std::memcpy(&header, bytes.data(), sizeof(header));
+    std::memcpy(&footer, bytes.data() + bytes.size() - sizeof(footer), sizeof(footer));
+    if (std::memcmp(header.magic, TrajectoryMagic, sizeof(TrajectoryMagic)) != 0) {
+        error = "not a trajectory";
+        return nullptr;
+    }
+    if (header.version != TrajectoryVersion || header.codec > TrajectoryCodec::QUANTISED) {
+        error = "trajectory version " + std::to_string(header.version) + " can't be read by this build";
+        return nullptr;
+    }
+    // the footer is written last, so a recording that was cut off has none
+    if (std::memcmp(footer.magic, TrajectoryFooterMagic, sizeof(TrajectoryFooterMagic)) != 0) {
+        error = "trajectory has no index, the recording didn't finish";
+        return nullptr;
+    }
+
+    const auto sizesBytes = header.balls * 2 * sizeof(float);
+    const auto indexBytes = footer.chunks * sizeof(TrajectoryIndexEntry);
+    if (header.ballBlock == 0 || header.framesPerChunk == 0 || sizeof(header) + sizesBytes > footer.indexOffset ||
+        footer.indexOffset + indexBytes + sizeof(footer) != bytes.size()) {
+        error = "trajectory layout doesn't match the file size";
+        return nullptr;
+    }
+
+    reader->_index.resize(static_cast<std::size_t>(footer.chunks));
+    std::memcpy(reader->_index.data(), bytes.data() + footer.indexOffset, static_cast<std::size_t>(indexBytes));
+    std::uint64_t nextFrame = 0;
+    for (const auto& entry : reader->_index) {
+        if (entry.firstFrame < nextFrame || entry.frames == 0 || entry.frames > header.framesPerChunk ||
+            entry.bytes < sizeof(TrajectoryChunkHeader) || entry.offset < sizeof(header) + sizesBytes ||
+            entry.offset + entry.bytes > footer.indexOffset) {
+            error = "trajectory index is corrupt";
+            return nullptr;
+        }
+        nextFrame = entry.firstFrame + entry.frames;
+    }
+
+    const auto balls = static_cast<std::size_t>(header.balls);
+    const auto* sizes = bytes.data() + sizeof(header);
+    reader->_radii.resize(balls);
+    reader->_masses.resize(balls);
+    for (std::size_t i = 0; i < balls; i++, sizes += 2 * sizeof(float)) {
+        std::memcpy(&reader->_radii[i], sizes, sizeof(float));
+        std::memcpy(&reader->_masses[i], sizes + sizeof(float), sizeof(float));
+    }
+
+    reader->_residuals.resize(header.framesPerChunk);
+    reader->_file = std::move(file);
+    return reader;
+}
+
+std::size_t TrajectoryReader::find_chunk(std::uint64_t frame) const {
+    const auto after = std::upper_bound(std::begin(_index), std::end(_index), frame,
+        [](std::uint64_t frame, const TrajectoryIndexEntry& entry) { return frame < entry.firstFrame; });
+    if (after == std::begin(_index) || frame >= std::prev(after)->firstFrame + std::prev(after)->frames) {
+        return _index.size();
+    }
+    return static_cast<std::size_t>(std::prev(after) - std::begin(_index));
+}
+
+bool TrajectoryReader::locate(std::size_t chunk, TrajectoryChunkHeader& header,
+    const std::uint8_t* (&columns)[TrajectoryColumns + 1]) const {
+    const auto& entry = _index[chunk];
+    const auto* start = reinterpret_cast<const std::uint8_t*>(_file->bytes().data()) + entry.offset;
+    std::memcpy(&header, start, sizeof(header));
+
+    const auto blocks = (balls() + _header.ballBlock - 1) / _header.ballBlock;
+    if (header.frames != entry.frames || header.blocks != blocks) {
+        return false;
+    }
+    columns[0] = start + sizeof(header);
+    for (std::uint32_t c = 0; c < TrajectoryColumns; c++) {
+        if (header.columnBytes[c] < blocks * sizeof(std::uint64_t) ||
+            header.columnBytes[c] > static_cast<std::uint64_t>(start + entry.bytes - columns[c]) ||
+            !(std::isfinite(header.quantum[c]) && header.quantum[c] >= 0.0f)) {
+            return false;
+        }
+        columns[c + 1] = columns[c] + header.columnBytes[c];
+    }
+    return true;
+}
+
+bool TrajectoryReader::decode(std::size_t chunk) {
+    if (chunk == _chunk) {
+        return true;
+    }
+    _chunk = std::numeric_limits<std::size_t>::max();
+
+    TrajectoryChunkHeader header;
+    const std::uint8_t* columns[TrajectoryColumns + 1];
+    if (!locate(chunk, header, columns)) {
+        return false;
+    }
+
+    const auto balls = this->balls();
+    const auto stride = balls * TrajectoryColumns;
+    _values.resize(stride * header.frames);
+    for (std::uint32_t c = 0; c < TrajectoryColumns; c++) {
+        const auto* data = columns[c] + header.blocks * sizeof(std::uint64_t);
+        for (std::size_t ball = 0; ball < balls; ball++) {
+            DecodeSeries(_header, header, c, data, columns[c + 1], header.frames, header.frames, _residuals.data(),
+                _values.data() + ball * TrajectoryColumns + c, stride);
+        }
+        // every ball of a column is packed back to back, so one that decodes to another length is corrupt
+        if (data != columns[c + 1]) {
+            return false;
+        }
+    }
+
+    _chunk = chunk;
+    return true;
+}
+
+std::span<const float> TrajectoryReader::frame(std::uint64_t frame) {
+    const auto chunk = find_chunk(frame);
+    if (chunk == _index.size() || !decode(chunk)) {
+        return {};
+    }
+    const auto stride = balls() * TrajectoryColumns;
+    return std::span<const float>(_values).subspan(static_cast<std::size_t>(frame - _index[chunk].firstFrame) * stride, stride);
+}
+
+TrajectorySeries TrajectoryReader::series(std::size_t ball, std::uint64_t first, std::uint64_t last, std::uint32_t columns) {
+    _queryFrames.clear();
+    _query.clear();
+    columns &= TrajectoryAllColumns;
+    const auto stride = static_cast<std::size_t>(std::popcount(columns));
+    if (ball >= balls() || first > last || stride == 0) {
+        return {};
+    }
+    _series.resize(_header.framesPerChunk);
+
+    auto chunk = static_cast<std::size_t>(std::partition_point(std::begin(_index), std::end(_index),
+        [first](const TrajectoryIndexEntry& entry) { return entry.firstFrame + entry.frames <= first; }) - std::begin(_index));
+    for (; chunk < _index.size() && _index[chunk].firstFrame <= last; chunk++) {
+        const auto& entry = _index[chunk];
+        TrajectoryChunkHeader header;
+        const std::uint8_t* columnStarts[TrajectoryColumns + 1];
+        if (!locate(chunk, header, columnStarts)) {
+            _queryFrames.clear();
+            _query.clear();
+            return { {}, {}, true };
+        }
+
+        const auto from = static_cast<std::uint32_t>(std::max(first, entry.firstFrame) - entry.firstFrame);
+        const auto to = static_cast<std::uint32_t>(std::min(last - entry.firstFrame, std::uint64_t{ entry.frames - 1 }));
+        const auto base = _query.size();
+        _query.resize(base + (to - from + 1) * stride);
+        for (auto frame = from; frame <= to; frame++) {
+            _queryFrames.push_back(entry.firstFrame + frame);
+        }
+
+        auto slot = base;
+        for (std::uint32_t c = 0; c < TrajectoryColumns; c++) {
+            if ((columns & (1u << c)) == 0) {
+                continue;
+            }
+            // the block offset gets us to within a block of ball, the rest are skipped over
+            const auto* data = columnStarts[c] + header.blocks * sizeof(std::uint64_t);
+            const auto* end = columnStarts[c + 1];
+            std::uint64_t offset;
+            std::memcpy(&offset, columnStarts[c] + ball / _header.ballBlock * sizeof(offset), sizeof(offset));
+            data += std::min<std::uint64_t>(offset, static_cast<std::uint64_t>(end - data));
+            for (auto skipped = ball - ball % _header.ballBlock; skipped < ball; skipped++) {
+                SkipSeries(data, end, header.frames);
+            }
+
+            DecodeSeries(_header, header, c, data, end, header.frames, to + 1, _residuals.data(), _series.data(), 1);
+            for (auto frame = from; frame <= to; frame++) {
+                _query[slot + (frame - from) * stride] = _series[frame];
+            }
+            slot++;
+        }
+    }
+    return { _queryFrames, _query };
+}
+
+std::span<const float> TrajectoryReader::slice(std::uint64_t frame, std::uint32_t columns) {
+    _query.clear();
+    columns &= TrajectoryAllColumns;
+    const auto stride = static_cast<std::size_t>(std::popcount(columns));
+    const auto chunk = find_chunk(frame);
+    if (chunk == _index.size() || stride == 0) {
+        return {};
+    }
+
+    const auto balls = this->balls();
+    const auto wanted = static_cast<std::uint32_t>(frame - _index[chunk].firstFrame) + 1;
+    _query.resize(balls * stride);
+
+    // the chunk frame() has decoded already only needs picking from
+    if (chunk == _chunk) {
+        const auto* values = _values.data() + (wanted - 1) * balls * TrajectoryColumns;
+        auto* out = _query.data();
+        for (std::size_t ball = 0; ball < balls; ball++, values += TrajectoryColumns) {
+            for (std::uint32_t c = 0; c < TrajectoryColumns; c++) {
+                if ((columns & (1u << c)) != 0) {
+                    *out++ = values[c];
+                }
+            }
+        }
+        return _query;
+    }
+
+    TrajectoryChunkHeader header;
+    const std::uint8_t* columnStarts[TrajectoryColumns + 1];
+    if (!locate(chunk, header, columnStarts)) {
+        _query.clear();
+        return {};
+    }
+    _series.resize(_header.framesPerChunk);
+
+    std::size_t slot = 0;
+    for (std::uint32_t c = 0; c < TrajectoryColumns; c++) {
+        if ((columns & (1u << c)) == 0) {
+            continue;
+        }
+        const auto* data = columnStarts[c] + header.blocks * sizeof(std::uint64_t);
+        const auto* end = columnStarts[c + 1];
+        for (std::size_t ball = 0; ball < balls; ball++) {
+            DecodeSeries(_header, header, c, data, end, header.frames, wanted, _residuals.data(), _series.data(), 1);
+            _query[ball * stride + slot] = _series[wanted - 1];
+        }
+        if (data != end) {
+            _query.clear();
+            return {};
+        }
+        slot++;
+    }
+    return _query;
+}
@@ -0,0 +1,92 @@
+#pragma once
+
+#include "trajectoryformat.hpp"
+#include "mappedfile.hpp"
+#include "rectangle.hpp"
+#include <cstdint>
+#include <limits>
+#include <memory>
+#include <span>
+#include <string>
+#include <vector>
+
+namespace BallSimulator {
+    // which columns a query decodes, one bit each in column order
+    constexpr std::uint32_t TrajectoryPositions = 0x3;
+    constexpr std::uint32_t TrajectoryVelocities = 0xC;
+    constexpr std::uint32_t TrajectoryAllColumns = 0xF;
+
+    // the recorded frames a series query covered and, for each in turn, the columns asked for.
+    // corrupt is set, and nothing returned, when a chunk in the range couldn't be read
+    struct TrajectorySeries {
+        std::span<const std::uint64_t> frames;
+        std::span<const float> values;
+        bool corrupt = false;
+    };
+
+    // Random access to a trajectory file through a read-only mapping, so only the chunks that
+    // are asked for ever get paged in and a recording far bigger than memory can be played.
+    // frame() decodes the whole chunk holding a frame and keeps it, so stepping through a
+    // recording decodes every chunk once. series() and slice() answer one-off queries and
+    // decode only the columns, balls and frames they need.
+    class TrajectoryReader {
+        std::unique_ptr<MappedFile> _file;
+        TrajectoryHeader _header{};
+        TrajectoryFooter _footer{};
+        std::vector<TrajectoryIndexEntry> _index;
+        std::vector<float> _radii, _masses;
+
+        std::size_t _chunk = std::numeric_limits<std::size_t>::max();
+        std::vector<float> _values;         // frame by frame, then ball by ball, then column
+        std::vector<std::uint32_t> _residuals;
+        std::vector<float> _series;
+
+        std::vector<std::uint64_t> _queryFrames;
+        std::vector<float> _query;
+
+        TrajectoryReader() = default;
+
+        // where each column of chunk starts, then where the last one ends; false if corrupt
+        bool locate(std::size_t chunk, TrajectoryChunkHeader& header, const std::uint8_t* (&columns)[TrajectoryColumns + 1]) const;
+        bool decode(std::size_t chunk);
+
+    public:
+        TrajectoryReader(const TrajectoryReader&) = delete;
+        TrajectoryReader& operator =(const TrajectoryReader&) = delete;
+
+        // null with error set if the file can't be opened or isn't a complete trajectory
+        static std::unique_ptr<TrajectoryReader> open(const std::string& path, std::string& error);
+
+        inline const TrajectoryHeader& header() const { return _header; }
+        inline std::size_t balls() const { return static_cast<std::size_t>(_header.balls); }
+        // frames offered to the writer, including any it dropped
+        inline std::uint64_t frames() const { return _footer.frames; }
+        inline float frame_time() const { return _header.frameTime; }
+        inline Rectangle<float> bounds() const {
+            return { _header.bounds[0], _header.bounds[1], _header.bounds[2], _header.bounds[3] };
+        }
+
+        inline std::span<const float> radii() const { return _radii; }
+        inline std::span<const float> masses() const { return _masses; }
+
+        // every chunk in frame order; each one starts with a keyframe
+        inline std::span<const TrajectoryIndexEntry> chunks() const { return _index; }
+
+        // the chunk holding frame, or chunks().size() if no chunk does
+        std::size_t find_chunk(std::uint64_t frame) const;
+
+        // x, y, vx and vy of every ball in turn at frame; empty if the frame was dropped or its
+        // chunk is corrupt. only valid until the next call
+        std::span<const float> frame(std::uint64_t frame);
+
+        // the chosen columns of ball at every recorded frame from first to last. each chunk is
+        // entered at the block offset before ball and only ball's own series gets decoded; only
+        // valid until the next query
+        TrajectorySeries series(std::size_t ball, std::uint64_t first, std::uint64_t last,
+            std::uint32_t columns = TrajectoryAllColumns);
+
+        // the chosen columns of every ball in turn at frame, decoding each series no further
+        // than that frame; empty if it wasn't recorded. only valid until the next query
+        std::span<const float> slice(std::uint64_t frame, std::uint32_t columns = TrajectoryAllColumns);
+    };
+}
@@ -0,0 +1,286 @@
+#include "trajectorywriter.hpp"
+#include "world.hpp"
+
+#include <algorithm>
+#include <bit>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <limits>
+
+using namespace BallSimulator;
+
+std::unique_ptr<TrajectoryWriter> TrajectoryWriter::create(const std::string& path, const World& world, float frameTime,
+    float errorBound, OutputPolicy policy, std::uint32_t framesPerChunk) {
+    auto* file = std::fopen(path.c_str(), "wb");
+    if (file == nullptr) {
+        return nullptr;
+    }
+
+    std::unique_ptr<TrajectoryWriter> writer(new TrajectoryWriter());
+    writer->_file = file;
+
+    // a chunk is buffered whole before it is encoded, so big worlds get fewer frames per chunk
+    const auto& entities = world.entities();
+    const auto frameBytes = std::max<std::size_t>(entities.size(), 1) * TrajectoryColumns * sizeof(float);
+    framesPerChunk = static_cast<std::uint32_t>(std::clamp<std::size_t>(TRAJECTORY_CHUNK_BYTES / frameBytes, 2,
+        std::max(framesPerChunk, 2u)));
+
+    auto& header = writer->_header;
+    std::memcpy(header.magic, TrajectoryMagic, sizeof(TrajectoryMagic));
+    header.version = TrajectoryVersion;
+    header.codec = errorBound > 0.0f ? TrajectoryCodec::QUANTISED : TrajectoryCodec::LOSSLESS;
+    header.balls = entities.size();
+    header.framesPerChunk = framesPerChunk;
+    header.ballBlock = TRAJECTORY_BALL_BLOCK;
+    header.bounds[0] = world.bounds().x;
+    header.bounds[1] = world.bounds().y;
+    header.bounds[2] = world.bounds().w;
+    header.bounds[3] = world.bounds().h;
+    header.frameTime = frameTime;
+    header.errorBound = std::max(errorBound, 0.0f);
+    writer->write(&header, sizeof(header));
+
+    std::vector<float> sizes;
+    sizes.reserve(entities.size() * 2);
+    for (const auto& ball : entities) {
+        sizes.push_back(ball.radius());
+        sizes.push_back(ball.mass());
+    }
+    writer->write(sizes.data(), sizes.size() * sizeof(float));
+
+    // a chunk's worth of frames can queue up while the previous chunk is being encoded
+    writer->_chunk.values.reserve(frameBytes / sizeof(float) * framesPerChunk);
+    writer->_residuals.resize(framesPerChunk);
+    writer->_output = std::make_unique<OutputStage<Frame>>(framesPerChunk, policy,
+        [writer = writer.get()](Frame& frame) { writer->consume(frame); });
+    return writer;
+}
+
+TrajectoryWriter::~TrajectoryWriter() {
+    close();
+}
+
+void TrajectoryWriter::write(const void* data, std::size_t bytes) {
+    if (bytes > 0 && std::fwrite(data, 1, bytes, _file) != bytes) {
+        _ok = false;
+    }
+    _offset += bytes;
+}
+
+bool TrajectoryWriter::record(const World& world) {
+    const auto& entities = world.entities();
+    if (_file == nullptr || entities.size() != _header.balls) {
+        return false;
+    }
+
+    const auto index = _frames++;
+    auto* frame = _output->acquire();
+    if (frame == nullptr) {
+        return false;
+    }
+    frame->index = index;
+    frame->values.resize(entities.size() * TrajectoryColumns);
+    auto* out = frame->values.data();
+    for (const auto& ball : entities) {
+        out[0] = ball.get_position().x;
+        out[1] = ball.get_position().y;
+        out[2] = ball.get_velocity().x;
+        out[3] = ball.get_velocity().y;
+        out += TrajectoryColumns;
+    }
+    _output->publish();
+    return true;
+}
+
+void TrajectoryWriter::consume(Frame& frame) {
+    if (_chunk.frames > 0 && frame.index != _chunk.firstFrame + _chunk.frames) {
+        encode();
+    }
+    if (_chunk.frames == 0) {
+        _chunk.firstFrame = frame.index;
+    }
+    _chunk.values.insert(std::end(_chunk.values), std::begin(frame.values), std::end(frame.values));
+    _chunk.frames++;
+    _rawBytes += frame.values.size() * sizeof(float);
+
+    if (_chunk.frames == _header.framesPerChunk) {
+        encode();
+    }
+}
+
+void TrajectoryWriter::encode() {
+    const auto start = std::chrono::steady_clock::now();
+    const auto& chunk = _chunk;
+    const auto balls = static_cast<std::size_t>(_header.balls);
+    const auto block = static_cast<std::size_t>(_header.ballBlock);
+
+    TrajectoryChunkHeader header{};
+    header.firstFrame = chunk.firstFrame;
+    header.frames = chunk.frames;
+    header.blocks = static_cast<std::uint32_t>((balls + block - 1) / block);
+
+    _encoded.resize(sizeof(header));
+    for (std::uint32_t column = 0; column < TrajectoryColumns; column++) {
+        const auto offsetsStart = _encoded.size();
+        auto quantum = _header.codec == TrajectoryCodec::QUANTISED ? column_quantum(column) : 0.0f;
+        auto error = 0.0f;
+        if (!encode_column(column, quantum, error)) {
+            // a rounded value missed the bound after all, so the column goes in exactly
+            _encoded.resize(offsetsStart);
+            quantum = 0.0f;
+            encode_column(column, quantum, error);
+        }
+        if (_header.codec == TrajectoryCodec::QUANTISED && quantum == 0.0f) {
+            _losslessColumns++;
+        }
+        _maxError[column] = std::max(_maxError[column], error);
+        header.quantum[column] = quantum;
+        header.columnBytes[column] = _encoded.size() - offsetsStart;
+    }
+    std::memcpy(_encoded.data(), &header, sizeof(header));
+
+    _index.push_back({ chunk.firstFrame, _offset, _encoded.size(), chunk.frames, 0 });
+    write(_encoded.data(), _encoded.size());
+
+    _chunk.frames = 0;
+    _chunk.values.clear();
+    _encodeSeconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+void TrajectoryWriter::encode_lossless(const float* values, std::size_t stride, std::uint32_t frames) {
+    auto previous = std::bit_cast<std::uint32_t>(values[0]);
+    auto step = 0u;
+    PutVarint(_encoded, previous);
+    for (std::uint32_t frame = 1; frame < frames; frame++) {
+        const auto bits = std::bit_cast<std::uint32_t>(values[frame * stride]);
+        _residuals[frame - 1] = ZigZag(static_cast<std::int32_t>(bits - previous - step));
+        step = bits - previous;
+        previous = bits;
+    }
+    PutResiduals(_encoded, _residuals.data(), frames - 1);
+}
+
+float TrajectoryWriter::column_quantum(std::uint32_t column) const {
+    const double origin = TrajectoryOrigin(_header, column);
+    const auto stride = static_cast<std::size_t>(_header.balls) * TrajectoryColumns;
+    const auto count = static_cast<std::size_t>(_chunk.frames) * stride;
+    double largest = 0.0, furthest = 0.0;
+    for (auto i = static_cast<std::size_t>(column); i < count; i += TrajectoryColumns) {
+        const double value = _chunk.values[i];
+        if (!std::isfinite(value)) {
+            return 0.0f;
+        }
+        largest = std::max(largest, std::abs(value));
+        furthest = std::max(furthest, std::abs(value - origin));
+    }
+
+    // the reader rounds what it decodes to the nearest float, up to half an ulp of the largest
+    // value it can decode to; taking a whole ulp off the step leaves room for that rounding
+    const double bound = _header.errorBound;
+    const auto magnitude = static_cast<float>(largest + bound);
+    const double ulp = std::nextafter(magnitude, std::numeric_limits<float>::infinity()) - magnitude;
+    const auto wanted = 2.0 * bound - ulp;
+    auto quantum = static_cast<float>(wanted);
+    if (quantum > wanted) {
+        quantum = std::nextafter(quantum, 0.0f);
+    }
+
+    // every value has to be a whole number of steps from the origin that fits in 31 bits
+    constexpr double limit = 2147483647.0;
+    if (!(quantum > 0.0f) || furthest / quantum >= limit) {
+        return 0.0f;
+    }
+    return quantum;
+}
+
+bool TrajectoryWriter::encode_column(std::uint32_t column, float quantum, float& error) {
+    const auto balls = static_cast<std::size_t>(_header.balls);
+    const auto block = static_cast<std::size_t>(_header.ballBlock);
+    const auto stride = balls * TrajectoryColumns;
+    const auto blocks = (balls + block - 1) / block;
+
+    const auto offsetsStart = _encoded.size();
+    _encoded.resize(offsetsStart + blocks * sizeof(std::uint64_t));
+    const auto dataStart = _encoded.size();
+    error = 0.0f;
+    for (std::size_t ball = 0; ball < balls; ball++) {
+        if (ball % block == 0) {
+            const std::uint64_t offset = _encoded.size() - dataStart;
+            std::memcpy(_encoded.data() + offsetsStart + ball / block * sizeof(offset), &offset, sizeof(offset));
+        }
+
+        const auto* values = _chunk.values.data() + ball * TrajectoryColumns + column;
+        if (quantum > 0.0f) {
+            error = std::max(error, encode_quantised(values, stride, _chunk.frames, column, quantum));
+        } else {
+            encode_lossless(values, stride, _chunk.frames);
+        }
+    }
+    return error <= _header.errorBound;
+}
+
+float TrajectoryWriter::encode_quantised(const float* values, std::size_t stride, std::uint32_t frames,
+    std::uint32_t column, float quantum) {
+    const double origin = TrajectoryOrigin(_header, column);
+    const double step = quantum;
+
+    auto error = 0.0f;
+    std::uint32_t previous = 0, change = 0;
+    for (std::uint32_t frame = 0; frame < frames; frame++) {
+        const auto value = values[frame * stride];
+        const auto fixed = static_cast<std::int32_t>(std::nearbyint((value - origin) / step));
+        // measured on the float the reader hands back, as DecodeSeries computes it
+        const auto decoded = static_cast<float>(origin + fixed * step);
+        error = std::max(error, std::abs(decoded - value));
+
+        const auto bits = static_cast<std::uint32_t>(fixed);
+        if (frame == 0) {
+            PutVarint(_encoded, ZigZag(fixed));
+        } else {
+            _residuals[frame - 1] = ZigZag(static_cast<std::int32_t>(bits - previous - change));
+            change = bits - previous;
+        }
+        previous = bits;
+    }
+    PutResiduals(_encoded, _residuals.data(), frames - 1);
+    return error;
+}
+
+bool TrajectoryWriter::close() {
+    if (_file == nullptr) {
+        return _ok;
+    }
+    _output->stop();
+    if (_chunk.frames > 0) {
+        encode();
+    }
+
+    TrajectoryFooter footer{};
+    footer.indexOffset = _offset;
+    footer.chunks = _index.size();
+    footer.frames = _frames;
+    std::memcpy(footer.magic, TrajectoryFooterMagic, sizeof(TrajectoryFooterMagic));
+    write(_index.data(), _index.size() * sizeof(TrajectoryIndexEntry));
+    write(&footer, sizeof(footer));
+
+    _ok = std::fclose(_file) == 0 && _ok;
+    _file = nullptr;
+
+    _stats.chunks = _index.size();
+    _stats.rawBytes = _rawBytes;
+    _stats.writtenBytes = _offset;
+    _stats.encodeSeconds = _encodeSeconds;
+    _stats.maxPositionError = std::max(_maxError[0], _maxError[1]);
+    _stats.maxVelocityError = std::max(_maxError[2], _maxError[3]);
+    _stats.losslessColumns = _losslessColumns;
+    return _ok;
+}
+
+const TrajectoryStats& TrajectoryWriter::stats() {
+    _stats.frames = _frames;
+    if (_output != nullptr) {
+        _stats.output = _output->stats();
+    }
+    return _stats;
+}
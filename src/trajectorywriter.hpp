@@ -0,0 +1,103 @@
+#pragma once
+
+#include "trajectoryformat.hpp"
+#include "outputstage.hpp"
+#include "config.h"
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace BallSimulator {
+    class World;
+
+    struct TrajectoryStats {
+        std::uint64_t frames = 0;           // offered to record(), including dropped ones
+        std::uint64_t chunks = 0;
+        std::uint64_t rawBytes = 0;         // what the written frames would take as plain floats
+        std::uint64_t writtenBytes = 0;
+        double encodeSeconds = 0.0;         // spent on the writer thread
+        float maxPositionError = 0.0f;      // largest quantisation error actually made
+        float maxVelocityError = 0.0f;
+        std::uint64_t losslessColumns = 0;  // chunk columns a QUANTISED file had to store exactly
+        OutputStats output;
+    };
+
+    // Streams frames of a world to a trajectory file. record() only copies the balls into a
+    // free slot of the output ring; chunking, encoding and writing all happen on the writer
+    // thread. A dropped frame leaves a gap: the chunk being filled is cut short there and
+    // the next one starts at the following frame, so the index still says where every
+    // recorded frame is.
+    class TrajectoryWriter {
+        struct Frame {
+            std::uint64_t index = 0;
+            std::vector<float> values;      // ball by ball, then column
+        };
+
+        struct Chunk {
+            std::uint64_t firstFrame = 0;
+            std::uint32_t frames = 0;
+            std::vector<float> values;      // frame by frame, then ball by ball, then column
+        };
+
+        // everything below the output stage belongs to the writer thread until close()
+        std::FILE* _file = nullptr;
+        TrajectoryHeader _header{};
+        std::uint64_t _frames = 0;
+        std::unique_ptr<OutputStage<Frame>> _output;
+
+        std::vector<TrajectoryIndexEntry> _index;
+        std::uint64_t _offset = 0;
+        bool _ok = true;
+        Chunk _chunk;
+        std::vector<std::uint8_t> _encoded;
+        std::vector<std::uint32_t> _residuals;
+        std::uint64_t _rawBytes = 0;
+        double _encodeSeconds = 0.0;
+        float _maxError[TrajectoryColumns] = {};
+        std::uint64_t _losslessColumns = 0;
+
+        TrajectoryStats _stats;
+
+        TrajectoryWriter() = default;
+
+        void consume(Frame& frame);
+        void encode();
+        void encode_lossless(const float* values, std::size_t stride, std::uint32_t frames);
+        // the step column of the current chunk can be quantised at within the error bound, or 0
+        // if it has to be stored losslessly
+        float column_quantum(std::uint32_t column) const;
+        // appends the block offsets and every ball's series of column; false if a quantised
+        // value ended up further than the error bound, error being the furthest
+        bool encode_column(std::uint32_t column, float quantum, float& error);
+        float encode_quantised(const float* values, std::size_t stride, std::uint32_t frames, std::uint32_t column,
+            float quantum);
+        void write(const void* data, std::size_t bytes);
+
+    public:
+        ~TrajectoryWriter();
+
+        TrajectoryWriter(const TrajectoryWriter&) = delete;
+        TrajectoryWriter& operator =(const TrajectoryWriter&) = delete;
+
+        // null if the file can't be created. the ball count, sizes and bounds are taken from
+        // world here; frameTime is the simulated time between two recorded frames. a positive
+        // errorBound stores positions and velocities quantised to within that much of the truth
+        static std::unique_ptr<TrajectoryWriter> create(const std::string& path, const World& world, float frameTime,
+            float errorBound = 0.0f, OutputPolicy policy = OutputPolicy::BLOCK,
+            std::uint32_t framesPerChunk = TRAJECTORY_CHUNK_FRAMES);
+
+        // false if the frame was dropped, or world no longer has the balls it had at create()
+        bool record(const World& world);
+
+        // writes the last partial chunk and the index; false if anything failed to write
+        bool close();
+
+        // queue depth of frames not yet taken by the writer
+        inline std::size_t backlog() const { return _output != nullptr ? _output->depth() : 0; }
+
+        // output counters are live, the rest only complete after close()
+        const TrajectoryStats& stats();
+    };
+}
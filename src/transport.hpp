@@ -0,0 +1,38 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <vector>
+
+namespace BallSimulator {
+    struct TransportStats {
+        std::uint64_t messages = 0;
+        std::uint64_t bytes = 0;        // payload bytes sent
+        double waitSeconds = 0.0;       // time spent blocked in send, receive and barrier
+    };
+
+    // Point to point messaging between the ranks of a multi-process run. Messages between any
+    // two ranks arrive whole and in the order they were sent, and barrier() returns once every
+    // rank has reached it. Everything above this only sees bytes, so the shared memory
+    // implementation can be swapped for sockets without touching the simulation.
+    class Transport {
+    protected:
+        TransportStats _stats;
+
+    public:
+        virtual ~Transport() = default;
+
+        virtual unsigned rank() const = 0;
+        virtual unsigned size() const = 0;
+
+        // false if the message can never be delivered, e.g. it is bigger than the channel
+        virtual bool send(unsigned peer, std::span<const std::byte> message) = 0;
+        // blocks until the next message from peer has arrived
+        virtual void receive(unsigned peer, std::vector<std::byte>& message) = 0;
+        virtual void barrier() = 0;
+
+        inline const TransportStats& stats() const { return _stats; }
+        inline void reset_stats() { _stats = {}; }
+    };
+}
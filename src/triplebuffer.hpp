@@ -0,0 +1,40 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+
+// Lock-free single-producer/single-consumer triple buffer. The producer always has a private
+// slot to fill and the consumer a private slot to read, and the two only meet on an atomic
+// swap of the shared middle slot, so neither side ever waits on the other. The consumer only
+// ever sees the most recently published value; intermediate ones are dropped.
+template <typename T>
+class TripleBuffer {
+    static constexpr std::uint8_t IndexMask = 0x3;
+    static constexpr std::uint8_t Fresh = 0x4;
+
+    std::array<T, 3> _slots;
+    std::atomic<std::uint8_t> _middle{ 1 };
+    std::uint8_t _back = 0, _front = 2;
+
+public:
+    // producer side
+    inline T& back() noexcept { return _slots[_back]; }
+
+    inline void publish() noexcept {
+        const auto previous = _middle.exchange(_back | Fresh, std::memory_order_acq_rel);
+        _back = previous & IndexMask;
+    }
+
+    // consumer side; returns true if a newer value was picked up
+    inline bool update() noexcept {
+        if ((_middle.load(std::memory_order_acquire) & Fresh) == 0) {
+            return false;
+        }
+        const auto previous = _middle.exchange(_front, std::memory_order_acq_rel);
+        _front = previous & IndexMask;
+        return true;
+    }
+
+    inline const T& front() const noexcept { return _slots[_front]; }
+};
@@ -14,9 +14,9 @@ public:
 
     constexpr explicit vec2(T v) : x(v), y(v) {}
 
-    constexpr vec2(const vec2<T>& v) : x(v.x), y(v.y) {}
+    constexpr vec2(const vec2<T>& v) = default;
 
-    constexpr vec2(vec2<T>&& v) : x(v.x), y(v.y) {}
+    constexpr vec2(vec2<T>&& v) = default;
 
     template <typename F>
     constexpr vec2(const vec2<F>& v) : x(static_cast<T>(v.x)), y(static_cast<T>(v.y)) {}
@@ -28,23 +28,9 @@ public:
 
     // assignment
 
-    inline vec2<T>& operator =(vec2<T>& v) {
-        x = v.x;
-        y = v.y;
-        return *this;
-    }
+    inline vec2<T>& operator =(const vec2<T>& v) = default;
 
-    inline vec2<T>& operator =(const vec2<T>& v) {
-        x = v.x;
-        y = v.y;
-        return *this;
-    }
-
-    inline vec2<T>& operator =(vec2<T>&& v) {
-        x = v.x;
-        y = v.y;
-        return *this;
-    }
+    inline vec2<T>& operator =(vec2<T>&& v) = default;
 
     // compound vector arithmetic
 
@@ -2,25 +2,92 @@
 #include "quadtree.hpp"
 #include "config.h"
 
+#include <algorithm>
 #include <utility>
 
 using namespace BallSimulator;
 
 World::World() :
     _bounds(Rectangle<float>::zero()),
-    _gravity(0.0f) {
+    _gravity(0.0f),
+    _integrator(Integrator::SIMULATION_INTEGRATOR),
+    _scratch(1),
+    _threadingMode(ThreadingMode::SHARED_TREE),
+    _deterministic(false),
+    _seed(SIMULATION_SEED),
+    _generation(0) {
 }
 
 void World::resize(const Rectangle<float>& bounds) {
     _bounds = bounds;
-    _quadtree = CollisionQuadtree(0, _bounds);
+    _quadtree.reset(_bounds);
 }
 
-void World::scatter() {
-    for (auto& ball : _entities) {
-        ball->set_position(
-            rand() / (RAND_MAX / _bounds.w),
-            rand() / (RAND_MAX / _bounds.h)
-        );
+void World::set_threads(unsigned threads) {
+    threads = std::max(threads, 1u);
+    if (threads == this->threads()) {
+        return;
+    }
+
+    _pool = threads > 1 ? std::make_unique<ThreadPool>(threads) : nullptr;
+    _scheduler.reset();
+    _scratch.resize(threads);
+}
+
+TaskScheduler& World::scheduler() {
+    if (_scheduler == nullptr) {
+        _scheduler = std::make_unique<TaskScheduler>(threads());
+    }
+    return *_scheduler;
+}
+
+namespace {
+    template <typename F>
+    inline void ForEachBall(ThreadPool* pool, std::size_t begin, std::size_t end, F&& f) {
+        const auto body = [&](std::size_t first, std::size_t last, unsigned) {
+            for (auto i = begin + first; i < begin + last; i++) {
+                f(i);
+            }
+        };
+        if (pool != nullptr) {
+            pool->parallel_for(end - begin, PARALLEL_GRAIN_SIZE, body);
+        } else {
+            body(0, end - begin, 0);
+        }
+    }
+
+    inline vec2f RandomPosition(const Philox::Block& bits, const Rectangle<float>& bounds) {
+        return { bounds.x + Philox::uniform(bits[0]) * bounds.w, bounds.y + Philox::uniform(bits[1]) * bounds.h };
     }
+
+    inline vec2f RandomVelocity(const Philox::Block& bits, float maxSpeed) {
+        return { (2.0f * Philox::uniform(bits[0]) - 1.0f) * maxSpeed, (2.0f * Philox::uniform(bits[1]) - 1.0f) * maxSpeed };
+    }
+}
+
+void World::scatter() {
+    const Philox random(_seed);
+    const auto generation = _generation++;
+    ForEachBall(pool(), 0, _entities.size(), [&](std::size_t i) {
+        _entities[i].set_position(RandomPosition(random(i, static_cast<std::uint32_t>(RandomStream::POSITION), generation), _bounds));
+    });
+}
+
+void World::scatter_velocities(float maxSpeed) {
+    const Philox random(_seed);
+    const auto generation = _generation++;
+    ForEachBall(pool(), 0, _entities.size(), [&](std::size_t i) {
+        _entities[i].set_velocity(RandomVelocity(random(i, static_cast<std::uint32_t>(RandomStream::VELOCITY), generation), maxSpeed));
+    });
+}
+
+void World::spawn(std::size_t count, const Ball& prototype, float maxSpeed) {
+    const Philox random(_seed);
+    const auto generation = _generation++;
+    const auto first = _entities.size();
+    _entities.resize(first + count, prototype);
+    ForEachBall(pool(), first, _entities.size(), [&](std::size_t i) {
+        _entities[i].set_position(RandomPosition(random(i, static_cast<std::uint32_t>(RandomStream::POSITION), generation), _bounds));
+        _entities[i].set_velocity(RandomVelocity(random(i, static_cast<std::uint32_t>(RandomStream::VELOCITY), generation), maxSpeed));
+    });
 }
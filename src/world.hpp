@@ -2,14 +2,32 @@
 
 #include "simulator.hpp"
 #include "ball.hpp"
+#include "integrator.hpp"
+#include "threadpool.hpp"
+#include "domain.hpp"
+#include "scheduler.hpp"
+#include "random.hpp"
+#include <cstdint>
 #include <memory>
 
 namespace BallSimulator {
     class World {
         float _gravity;
-        std::vector<std::unique_ptr<Ball>> _entities;
+        Integrator _integrator;
+        SubstepPolicy _substepPolicy;
+        std::vector<Ball> _entities;
         CollisionQuadtree _quadtree;
         Rectangle<float> _bounds;
+        std::unique_ptr<ThreadPool> _pool;
+        std::vector<WorkerScratch> _scratch;
+        ThreadingMode _threadingMode;
+        DomainDecomposition _domain;
+        std::unique_ptr<TaskScheduler> _scheduler;
+        bool _deterministic;
+        ContactOrdering _ordering;
+        StepPhases _phases;
+        std::uint64_t _seed;
+        std::uint32_t _generation;
 
     public:
         World();
@@ -18,17 +36,52 @@ namespace BallSimulator {
         inline constexpr float width() const { return _bounds.w; }
         inline constexpr float height() const { return _bounds.h; }
         inline constexpr float gravity() const { return _gravity; }
+        inline constexpr Integrator integrator() const { return _integrator; }
+        inline constexpr const SubstepPolicy& substep_policy() const { return _substepPolicy; }
+        inline unsigned threads() const { return _pool != nullptr ? _pool->size() : 1; }
+        inline constexpr ThreadingMode threading_mode() const { return _threadingMode; }
+        inline constexpr bool deterministic() const { return _deterministic; }
 
         void resize(const Rectangle<float>& bounds);
         inline void set_gravity(float gravity) { _gravity = gravity; }
+        inline void set_integrator(Integrator integrator) { _integrator = integrator; }
+        inline void set_substep_policy(const SubstepPolicy& policy) { _substepPolicy = policy; }
+        void set_threads(unsigned threads);
+        inline void set_threading_mode(ThreadingMode mode) { _threadingMode = mode; }
+        // generate contacts in parallel but resolve them in sorted order, so results are
+        // bit-identical for any thread count (including one)
+        inline void set_deterministic(bool deterministic) { _deterministic = deterministic; }
+        // random draws are keyed by seed, ball index and how many draws came before, so they
+        // are identical for any thread count and safe to make from several worlds at once
+        inline void seed(std::uint64_t seed, std::uint32_t generation = 0) { _seed = seed; _generation = generation; }
+        inline constexpr std::uint64_t seed() const { return _seed; }
+        inline constexpr std::uint32_t generation() const { return _generation; }
         void scatter();
+        // each velocity component uniform in [-maxSpeed, maxSpeed]
+        void scatter_velocities(float maxSpeed);
+        // appends count copies of prototype at random positions with random velocities
+        void spawn(std::size_t count, const Ball& prototype, float maxSpeed);
 
-        void add(const Ball& ball) { _entities.emplace_back(std::make_unique<Ball>(ball)); }
-        void add(Ball&& ball)      { _entities.emplace_back(std::make_unique<Ball>(std::move(ball))); }
+        void add(const Ball& ball) { _entities.emplace_back(ball); }
+        void add(Ball&& ball)      { _entities.emplace_back(std::move(ball)); }
 
-        inline constexpr const std::vector<std::unique_ptr<Ball>>& entities() const { return _entities; }
+        inline constexpr const std::vector<Ball>& entities() const { return _entities; }
+        inline constexpr std::vector<Ball>& entities() { return _entities; }
         inline constexpr const CollisionQuadtree& quadtree() const { return _quadtree; }
         inline constexpr CollisionQuadtree& quadtree() { return _quadtree; }
         inline constexpr const Rectangle<float>& bounds() const { return _bounds; }
+
+        // null when running single threaded
+        inline ThreadPool* pool() const { return _pool.get(); }
+        inline std::vector<WorkerScratch>& scratch() { return _scratch; }
+        inline constexpr const DomainDecomposition& domain() const { return _domain; }
+        inline constexpr DomainDecomposition& domain() { return _domain; }
+        // created on first use, with one worker per world thread
+        TaskScheduler& scheduler();
+        inline const TaskScheduler* scheduler() const { return _scheduler.get(); }
+        inline constexpr const ContactOrdering& contact_ordering() const { return _ordering; }
+        inline constexpr ContactOrdering& contact_ordering() { return _ordering; }
+        inline constexpr const StepPhases& phases() const { return _phases; }
+        inline constexpr StepPhases& phases() { return _phases; }
     };
 }